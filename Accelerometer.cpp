@@ -163,6 +163,15 @@ bool AccelSensor::hasPendingEvents() const {
 	return mHasPendingEvent;
 }
 
+int AccelSensor::getRawScale(float *scale, int *field) const
+{
+	*field = 0;
+	scale[0] = CONVERT_ACCEL_X;
+	scale[1] = CONVERT_ACCEL_Y;
+	scale[2] = CONVERT_ACCEL_Z;
+	return 0;
+}
+
 int AccelSensor::setDelay(int32_t, int64_t delay_ns)
 {
 	int fd;
@@ -198,7 +207,7 @@ int AccelSensor::readEvents(sensors_event_t* data, int count)
 		return mEnabled ? 1 : 0;
 	}
 
-	ssize_t n = mInputReader.fill(data_fd);
+	ssize_t n = mInputReader.fill(data_fd, mUring, mUringSlot);
 	if (n < 0)
 		return n;
 
@@ -259,7 +268,7 @@ again:
 	/* if we didn't read a complete event, see if we can fill and
 	   try again instead of returning with nothing and redoing poll. */
 	if (numEventReceived == 0 && mEnabled == 1) {
-		n = mInputReader.fill(data_fd);
+		n = mInputReader.fill(data_fd, mUring, mUringSlot);
 		if (n)
 			goto again;
 	}
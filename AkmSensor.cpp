@@ -211,7 +211,7 @@ int AkmSensor::readEvents(sensors_event_t* data, int count)
 	if (count < 1)
 		return -EINVAL;
 
-	ssize_t n = mInputReader.fill(data_fd);
+	ssize_t n = mInputReader.fill(data_fd, mUring, mUringSlot);
 	if (n < 0)
 		return n;
 
@@ -46,6 +46,13 @@ LOCAL_SRC_FILES :=	\
 		CalibrationManager.cpp \
 		NativeSensorManager.cpp \
 		VirtualSensor.cpp	\
+		SensorEventQueue.cpp	\
+		SensorReader.cpp	\
+		SensorDirectChannel.cpp	\
+		SensorUring.cpp	\
+		SensorThread.cpp	\
+		SensorWakeLock.cpp	\
+		SensorInputIndex.cpp	\
 		sensors_XML.cpp
 
 LOCAL_C_INCLUDES += external/libxml2/include	\
@@ -153,6 +153,15 @@ bool PressureSensor::hasPendingEvents() const {
 	return mHasPendingEvent;
 }
 
+int PressureSensor::getRawScale(float *scale, int *field) const
+{
+	*field = 0;
+	scale[0] = CONVERT_PRESSURE;
+	scale[1] = 0;
+	scale[2] = 0;
+	return 0;
+}
+
 int PressureSensor::setDelay(int32_t, int64_t delay_ns)
 {
 	int fd;
@@ -182,7 +191,7 @@ int PressureSensor::readEvents(sensors_event_t* data, int count)
 		return mEnabled ? 1 : 0;
 	}
 
-	ssize_t n = mInputReader.fill(data_fd);
+	ssize_t n = mInputReader.fill(data_fd, mUring, mUringSlot);
 	if (n < 0)
 		return n;
 
@@ -238,7 +247,7 @@ again:
 	/* if we didn't read a complete event, see if we can fill and
 	   try again instead of returning with nothing and redoing poll. */
 	if (numEventReceived == 0 && mEnabled == 1) {
-		n = mInputReader.fill(data_fd);
+		n = mInputReader.fill(data_fd, mUring, mUringSlot);
 		if (n)
 			goto again;
 	}
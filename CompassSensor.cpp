@@ -128,6 +128,16 @@ bool CompassSensor::hasPendingEvents() const {
 	return mHasPendingEvent;
 }
 
+/* data[0..2] are calibrated by the algorithm, data[4..6] are the readings */
+int CompassSensor::getRawScale(float *scale, int *field) const
+{
+	*field = 4;
+	scale[0] = res;
+	scale[1] = res;
+	scale[2] = res;
+	return 0;
+}
+
 int CompassSensor::setDelay(int32_t, int64_t delay_ns)
 {
 	int fd;
@@ -163,10 +173,14 @@ int CompassSensor::readEvents(sensors_event_t* data, int count)
 		mHasPendingEvent = false;
 		mPendingEvent.timestamp = getTimestamp();
 		*data = mPendingEvent;
+		/* Not calibrated yet, so the readings are also the raw data */
+		data->data[4] = mPendingEvent.data[0];
+		data->data[5] = mPendingEvent.data[1];
+		data->data[6] = mPendingEvent.data[2];
 		return mEnabled ? 1 : 0;
 	}
 
-	ssize_t n = mInputReader.fill(data_fd);
+	ssize_t n = mInputReader.fill(data_fd, mUring, mUringSlot);
 	if (n < 0)
 		return n;
 
@@ -256,7 +270,7 @@ again:
 	/* if we didn't read a complete event, see if we can fill and
 	   try again instead of returning with nothing and redoing poll. */
 	if (numEventReceived == 0 && mEnabled == 1) {
-		n = mInputReader.fill(data_fd);
+		n = mInputReader.fill(data_fd, mUring, mUringSlot);
 		if (n)
 			goto again;
 	}
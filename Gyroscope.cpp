@@ -177,6 +177,16 @@ bool GyroSensor::hasPendingEvents() const {
 	return mHasPendingEvent;
 }
 
+/* data[0..2] are calibrated by the algorithm, data[4..6] are the readings */
+int GyroSensor::getRawScale(float *scale, int *field) const
+{
+	*field = 4;
+	scale[0] = CONVERT_GYRO_X;
+	scale[1] = CONVERT_GYRO_Y;
+	scale[2] = CONVERT_GYRO_Z;
+	return 0;
+}
+
 int GyroSensor::setDelay(int32_t, int64_t delay_ns)
 {
 	int fd;
@@ -209,10 +219,14 @@ int GyroSensor::readEvents(sensors_event_t* data, int count)
 		mHasPendingEvent = false;
 		mPendingEvent.timestamp = getTimestamp();
 		*data = mPendingEvent;
+		/* Not calibrated yet, so the readings are also the raw data */
+		data->data[4] = mPendingEvent.data[0];
+		data->data[5] = mPendingEvent.data[1];
+		data->data[6] = mPendingEvent.data[2];
 		return mEnabled ? 1 : 0;
 	}
 
-	ssize_t n = mInputReader.fill(data_fd);
+	ssize_t n = mInputReader.fill(data_fd, mUring, mUringSlot);
 	if (n < 0)
 		return n;
 
@@ -299,7 +313,7 @@ again:
 	/* if we didn't read a complete event, see if we can fill and
 	   try again instead of returning with nothing and redoing poll. */
 	if (numEventReceived == 0 && mEnabled == 1) {
-		n = mInputReader.fill(data_fd);
+		n = mInputReader.fill(data_fd, mUring, mUringSlot);
 		if (n)
 			goto again;
 	}
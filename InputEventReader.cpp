@@ -27,6 +27,7 @@
 #include <cutils/log.h>
 
 #include "InputEventReader.h"
+#include "SensorUring.h"
 
 /*****************************************************************************/
 
@@ -46,11 +47,13 @@ InputEventCircularReader::~InputEventCircularReader()
     delete [] mBuffer;
 }
 
-ssize_t InputEventCircularReader::fill(int fd)
+ssize_t InputEventCircularReader::fill(int fd, SensorUring *uring, int slot)
 {
     size_t numEventsRead = 0;
     if (mFreeSpace) {
-        const ssize_t nread = read(fd, mHead, mFreeSpace * sizeof(input_event));
+        const ssize_t nread = (uring != NULL) ?
+                uring->read(slot, mHead, mFreeSpace * sizeof(input_event)) :
+                read(fd, mHead, mFreeSpace * sizeof(input_event));
         if (nread<0 || nread % sizeof(input_event)) {
             // we got a partial event!!
             return nread<0 ? -errno : -EINVAL;
@@ -25,6 +25,7 @@
 /*****************************************************************************/
 
 struct input_event;
+class SensorUring;
 
 class InputEventCircularReader
 {
@@ -37,7 +38,8 @@ class InputEventCircularReader
 public:
 	InputEventCircularReader(size_t numEvents);
 	~InputEventCircularReader();
-	ssize_t fill(int fd);
+	/* Read from slot of uring if it is given, from fd with read(2) otherwise */
+	ssize_t fill(int fd, SensorUring *uring = NULL, int slot = -1);
 	ssize_t readEvent(input_event const** events);
 	void next();
 };
@@ -26,6 +26,11 @@ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
 OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
 IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 --------------------------------------------------------------------------*/
+#include <math.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <cutils/properties.h>
 #include "NativeSensorManager.h"
 
 ANDROID_SINGLETON_STATIC_INSTANCE(NativeSensorManager);
@@ -163,27 +168,62 @@ int NativeSensorManager::initVirtualSensor(struct SensorContext *ctx, int handle
 	ctx->driver = new VirtualSensor(ctx);
 	ctx->data_fd = -1;
 	ctx->is_virtual = true;
+	initFlags(ctx);
+	initOverload(ctx);
 
 	for (i = 0; i < sizeof(dep) * 8; i++) {
 		if (dep & (1ULL << i)) {
 			ref = getInfoByType(i);
 			if (ref != NULL) {
-				item = new SensorRefMap;
-				item->ctx = ref;
-				list_add_tail(&ctx->dep_list, &item->list);
+				item = allocRef(ref);
+				if (item != NULL)
+					list_add_tail(&ctx->dep_list, &item->list);
 			}
 		}
 	}
 
-	memset(ctx->enable_path, 0, sizeof(ctx->enable_path));
-	memset(ctx->data_path, 0, sizeof(ctx->data_path));
+	ctx->enable_path = "";
+	ctx->data_path = "";
 
-	type_map.add(ctx->sensor->type, ctx);
-	handle_map.add(ctx->sensor->handle, ctx);
+	addLookup(ctx);
 
 	return 0;
 }
 
+/* Index ctx by handle, type and data fd. A later sensor of the same type
+ * takes over the type lookup.
+ */
+void NativeSensorManager::addLookup(struct SensorContext *ctx)
+{
+	unsigned int i = ctx->sensor->handle - SENSORS_HANDLE(0);
+
+	if (i < (unsigned int)mCapacity)
+		handle_table[i] = ctx;
+	else
+		ALOGE("handle %d out of the lookup table", ctx->sensor->handle);
+
+	if ((unsigned int)ctx->sensor->type < MAX_SENSOR_TYPES)
+		type_table[ctx->sensor->type] = ctx;
+
+	if ((ctx->data_fd > 0) && (ctx->data_fd < FD_TABLE_SIZE))
+		fd_table[ctx->data_fd] = ctx;
+}
+
+SensorContext* NativeSensorManager::findByFd(int fd)
+{
+	int i;
+
+	if (fd <= 0)
+		return NULL;
+
+	for (i = 0; i < mSensorCount; i++) {
+		if (context[i].data_fd == fd)
+			return &context[i];
+	}
+
+	return NULL;
+}
+
 
 const struct SysfsMap NativeSensorManager::node_map[] = {
 	{offsetof(struct sensor_t, name), SYSFS_NAME, TYPE_STRING},
@@ -197,28 +237,57 @@ const struct SysfsMap NativeSensorManager::node_map[] = {
 };
 
 NativeSensorManager::NativeSensorManager():
-	mSensorCount(0), mScanned(false), mEventCount(0), type_map(NULL), handle_map(NULL), fd_map(NULL)
+	sensor_list(NULL), context(NULL), mSensorCount(0), mCapacity(0),
+	mMaskWords(0), active_mask(NULL), mStrings(NULL), mUring(NULL),
+	mRefPool(NULL), mHarmonic(false), mBackpressure(false), mBackpressureTime(0),
+	mWakeLock(NULL), mWakeLockHeld(false), mWakeSeq(0), mRcuPhase(0), mRetired(NULL),
+	mBatchRelease(-1)
 {
 	int i;
+	char propBuf[PROPERTY_VALUE_MAX];
+	int64_t start = SensorBase::getTimestamp();
+	int64_t discovered;
 
-	memset(sensor_list, 0, sizeof(sensor_list));
-	memset(context, 0, sizeof(context));
+	memset(mRcuReaders, 0, sizeof(mRcuReaders));
+	memset(mClients, 0, sizeof(mClients));
 
-	type_map.setCapacity(MAX_SENSORS);
-	handle_map.setCapacity(MAX_SENSORS);
-	fd_map.setCapacity(MAX_SENSORS);
+	list_init(&mRefFree);
+	mSnapshotFree = NULL;
 
-	for (i = 0; i < MAX_SENSORS; i++) {
-		context[i].sensor = &sensor_list[i];
-		sensor_list[i].name = context[i].name;
-		sensor_list[i].vendor = context[i].vendor;
-		list_init(&context[i].listener);
-		list_init(&context[i].dep_list);
-	}
+	handle_table = NULL;
+	memset(type_table, 0, sizeof(type_table));
+	memset(fd_table, 0, sizeof(fd_table));
 
 	if(getDataInfo()) {
 		ALOGE("Get data info failed\n");
 	}
+	discovered = SensorBase::getTimestamp();
+
+	property_get("sensors.rate.harmonic", propBuf, "0");
+	mHarmonic = (strcmp(propBuf, "1") == 0);
+
+	property_get("sensors.rate.backpressure", propBuf, "0");
+	mBackpressure = (strcmp(propBuf, "1") == 0);
+
+	property_get("sensors.fifo.watermark", propBuf, "75");
+	mWatermark = atoi(propBuf);
+	if ((mWatermark <= 0) || (mWatermark > 100))
+		mWatermark = DEFAULT_FIFO_WATERMARK;
+
+	for (i = 0; i < mSensorCount; i++) {
+		initFifo(&context[i]);
+		publishSnapshot(&context[i]);
+	}
+	synchronizeSnapshots();
+
+	initUring();
+
+	mWakeLock = SensorWakeLock::create();
+
+	/* SensorService waits for this in get_sensors_list() */
+	ALOGI("HAL init took %lld us, discovery %lld us\n",
+			(long long)(SensorBase::getTimestamp() - start) / 1000,
+			(long long)(discovered - start) / 1000);
 
 	dump();
 }
@@ -232,7 +301,16 @@ NativeSensorManager::~NativeSensorManager()
 	struct SensorContext *ctx;
 	struct SensorRefMap *item;
 
+	delete mUring;
+	if (mWakeLockHeld)
+		mWakeLock->release();
+	delete mWakeLock;
+
 	for (i = 0; i < number; i++) {
+		if (context[i].reader != NULL) {
+			delete context[i].reader;
+		}
+
 		if (context[i].driver != NULL) {
 			delete context[i].driver;
 		}
@@ -241,7 +319,7 @@ NativeSensorManager::~NativeSensorManager()
 			item = node_to_item(node, struct SensorRefMap, list);
 			if (item != NULL) {
 				list_remove(&item->list);
-				delete item;
+				freeRef(item);
 			}
 		}
 
@@ -249,10 +327,121 @@ NativeSensorManager::~NativeSensorManager()
 			item = node_to_item(node, struct SensorRefMap, list);
 			if (item != NULL) {
 				list_remove(&item->list);
-				delete item;
+				freeRef(item);
 			}
 		}
+
+		freeSnapshot(context[i].snapshot);
+		delete context[i].fifo;
+	}
+
+	while (mSnapshotFree != NULL) {
+		struct SensorSnapshot *snap = mSnapshotFree;
+		mSnapshotFree = snap->next;
+		freeSnapshot(snap);
+	}
+
+	while (mStrings != NULL) {
+		struct SensorString *s = mStrings;
+		mStrings = s->next;
+		free(s->str);
+		delete s;
+	}
+
+	delete [] mRefPool;
+	delete [] handle_table;
+	delete [] active_mask;
+	delete [] context;
+	delete [] sensor_list;
+}
+
+/* Size the registry for capacity sensors. Called once by the discovery,
+ * before any context is used.
+ */
+int NativeSensorManager::allocRegistry(int capacity)
+{
+	int i;
+
+	mCapacity = capacity;
+	mMaskWords = MASK_WORDS(capacity);
+
+	sensor_list = new sensor_t[capacity];
+	context = new SensorContext[capacity];
+	active_mask = new uint32_t[mMaskWords];
+	handle_table = new SensorContext*[capacity];
+	mRefPool = new SensorRefMap[capacity * REF_MAPS_PER_SENSOR];
+
+	memset(sensor_list, 0, capacity * sizeof(sensor_list[0]));
+	memset(context, 0, capacity * sizeof(context[0]));
+	memset(active_mask, 0, mMaskWords * sizeof(active_mask[0]));
+	memset(handle_table, 0, capacity * sizeof(handle_table[0]));
+
+	for (i = 0; i < capacity * REF_MAPS_PER_SENSOR; i++)
+		list_add_tail(&mRefFree, &mRefPool[i].list);
+
+	for (i = 0; i < capacity; i++) {
+		context[i].index = i;
+		context[i].sensor = &sensor_list[i];
+		context[i].enable_path = "";
+		context[i].data_path = "";
+		sensor_list[i].name = context[i].name;
+		sensor_list[i].vendor = context[i].vendor;
+		list_init(&context[i].listener);
+		list_init(&context[i].dep_list);
+	}
+
+	return 0;
+}
+
+/* Return a copy of str living as long as the manager, shared by the equal
+ * strings. Only called on discovery.
+ */
+const char* NativeSensorManager::intern(const char *str)
+{
+	struct SensorString *s;
+
+	if (*str == '\0')
+		return "";
+
+	for (s = mStrings; s != NULL; s = s->next) {
+		if (!strcmp(s->str, str))
+			return s->str;
+	}
+
+	s = new SensorString;
+	s->str = strdup(str);
+	s->next = mStrings;
+	mStrings = s;
+
+	return s->str;
+}
+
+/* The listener array is sized to the sensors, so snapshots are recycled
+ * rather than allocated on every change.
+ */
+struct SensorSnapshot* NativeSensorManager::allocSnapshot()
+{
+	struct SensorSnapshot *snap;
+
+	if (mSnapshotFree != NULL) {
+		snap = mSnapshotFree;
+		mSnapshotFree = snap->next;
+		return snap;
 	}
+
+	snap = new SensorSnapshot;
+	snap->listener = new SensorContext*[mCapacity];
+
+	return snap;
+}
+
+void NativeSensorManager::freeSnapshot(struct SensorSnapshot *snap)
+{
+	if (snap == NULL)
+		return;
+
+	delete [] snap->listener;
+	delete snap;
 }
 
 void NativeSensorManager::dump()
@@ -275,6 +464,10 @@ void NativeSensorManager::dump()
 				context[i].delay_ns,
 				context[i].enable);
 
+		ALOGI("overload=%d\ndropped=%u\n",
+				context[i].overload,
+				getDropCount(&context[i]));
+
 		ALOGI("Listener:");
 		list_for_each(node, &context[i].listener) {
 			ref = node_to_item(node, struct SensorRefMap, list);
@@ -299,6 +492,12 @@ int NativeSensorManager::getDataInfo() {
 	int has_gyro = 0;
 	struct sensor_t sensor_mag;
 	struct sensor_t sensor_gyro;
+	char propBuf[PROPERTY_VALUE_MAX];
+	bool use_reader;
+
+	/* Decode the hardware sensor events in per sensor reader threads */
+	property_get("sensors.reader.thread", propBuf, "0");
+	use_reader = (strcmp(propBuf, "1") == 0);
 
 	mSensorCount = getSensorListInner();
 	for (i = 0; i < mSensorCount; i++) {
@@ -306,23 +505,19 @@ int NativeSensorManager::getDataInfo() {
 		list = &context[i];
 		list->is_virtual = false;
 
-		item = new struct SensorRefMap;
-		item->ctx = list;
-		list_add_tail(&list->dep_list, &item->list);
+		item = allocRef(list);
+		if (item != NULL)
+			list_add_tail(&list->dep_list, &item->list);
 
 		if (strlen(list->data_path) != 0)
 			list->data_fd = open(list->data_path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
 		else
 			list->data_fd = -1;
 
-		if (list->data_fd > 0) {
-			fd_map.add(list->data_fd, list);
-		} else {
+		if (list->data_fd <= 0)
 			ALOGE("open %s failed, continue anyway.(%s)\n", list->data_path, strerror(errno));
-		}
 
-		type_map.add(list->sensor->type, list);
-		handle_map.add(list->sensor->handle, list);
+		addLookup(list);
 
 		switch (list->sensor->type) {
 			case SENSOR_TYPE_ACCELEROMETER:
@@ -354,6 +549,19 @@ int NativeSensorManager::getDataInfo() {
 				break;
 		}
 		initCalibrate(list);
+		initFlags(list);
+		if (list->driver != NULL)
+			list->has_raw = !list->driver->getRawScale(list->raw_scale,
+					&list->raw_field);
+		initOverload(list);
+
+		if (use_reader && (list->driver != NULL) && (list->data_fd >= 0)) {
+			list->reader = new SensorReader(list);
+			if (list->reader->start()) {
+				delete list->reader;
+				list->reader = NULL;
+			}
+		}
 	}
 
 
@@ -424,6 +632,9 @@ int NativeSensorManager::getDataInfo() {
 		}
 	}
 
+	/* Only needed to find the data paths */
+	SensorInputIndex::release();
+
 	return 0;
 }
 
@@ -446,14 +657,38 @@ int NativeSensorManager::registerListener(struct SensorContext *hw, struct Senso
 		}
 	}
 
-	item = new SensorRefMap;
-	item->ctx = virt;
+	item = allocRef(virt);
+	if (item == NULL)
+		return -ENOMEM;
 
 	list_add_tail(&hw->listener, &item->list);
 
 	return 0;
 }
 
+/* Take a node from the pool, the lists only change on the control path */
+struct SensorRefMap* NativeSensorManager::allocRef(struct SensorContext *ctx)
+{
+	struct SensorRefMap *item;
+
+	if (list_empty(&mRefFree)) {
+		ALOGE("Out of sensor reference nodes\n");
+		return NULL;
+	}
+
+	item = node_to_item(list_head(&mRefFree), struct SensorRefMap, list);
+	list_remove(&item->list);
+	item->ctx = ctx;
+
+	return item;
+}
+
+void NativeSensorManager::freeRef(struct SensorRefMap *item)
+{
+	item->ctx = NULL;
+	list_add_tail(&mRefFree, &item->list);
+}
+
 /* Remove the virtual sensor listener from the list specified by "hw" */
 int NativeSensorManager::unregisterListener(struct SensorContext *hw, struct SensorContext *virt)
 {
@@ -466,7 +701,7 @@ int NativeSensorManager::unregisterListener(struct SensorContext *hw, struct Sen
 		item = node_to_item(node, struct SensorRefMap, list);
 		if (item->ctx == virt) {
 			list_remove(&item->list);
-			delete item;
+			freeRef(item);
 			return 0;
 		}
 	}
@@ -481,26 +716,28 @@ int NativeSensorManager::getSensorList(const sensor_t **list) {
 	return mSensorCount;
 }
 
-int NativeSensorManager::getNode(char *buf, char *path, const struct SysfsMap *map) {
-	char * fret;
+/* Read the sysfs attribute node relative to dirfd, or the absolute path
+ * node if dirfd is AT_FDCWD, into the field of buf described by map.
+ */
+int NativeSensorManager::getNode(char *buf, int dirfd, const char *node, const struct SysfsMap *map) {
 	ssize_t len = 0;
 	int fd;
 	char tmp[SYSFS_MAXLEN];
 
-	if (NULL == buf || NULL == path)
+	if (NULL == buf || NULL == node)
 		return -1;
 
 	memset(tmp, 0, sizeof(tmp));
 
-	fd = open(path, O_RDONLY);
+	fd = openat(dirfd, node, O_RDONLY | O_CLOEXEC);
 	if (fd < 0) {
-		ALOGE("open %s failed.(%s)\n", path, strerror(errno));
+		ALOGE("open %s failed.(%s)\n", node, strerror(errno));
 		return -1;
 	}
 
 	len = read(fd, tmp, sizeof(tmp) - 1);
 	if ((len <= 0) || (strlen(tmp) == 0)) {
-		ALOGE("read %s failed.(%s)\n", path, strerror(errno));
+		ALOGE("read %s failed.(%s)\n", node, strerror(errno));
 		close(fd);
 		return -1;
 	}
@@ -525,95 +762,38 @@ int NativeSensorManager::getNode(char *buf, char *path, const struct SysfsMap *m
 	return 0;
 }
 
+/* Fall back on the input device named after the sensor, or else after its type */
 int NativeSensorManager::getEventPathOld(const struct SensorContext *list, char *event_path)
 {
-	struct dirent **namelist;
-	char *file;
-	char path[PATH_MAX];
-	char name[80];
-	int nNodes;
-	int fd = -1;
-	int j;
-
-	/* scan "/dev/input" to get information */
-	if (!mScanned) {
-		strlcpy(path, EVENT_PATH, sizeof(path));
-		file = path + strlen(EVENT_PATH);
-		nNodes = scandir(path, &namelist, 0, alphasort);
-		if (nNodes < 0) {
-			ALOGE("scan %s failed.(%s)\n", EVENT_PATH, strerror(errno));
-			return -1;
-		}
-
-		for (mEventCount = 0, j = 0; (j < nNodes) && (j < MAX_SENSORS); j++) {
-			if (namelist[j]->d_type != DT_CHR) {
-				continue;
-			}
-
-			strlcpy(file, namelist[j]->d_name, sizeof(path) - strlen(EVENT_PATH));
-
-			fd = open(path, O_RDONLY);
-			if (fd < 0) {
-				ALOGE("open %s failed(%s)", path, strerror(errno));
-				continue;
-			}
-
-			if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
-				name[0] = '\0';
-			}
-
-			strlcpy(event_list[mEventCount].data_name, name, sizeof(event_list[0].data_name));
-			strlcpy(event_list[mEventCount].data_path, path, sizeof(event_list[0].data_path));
-			close(fd);
-			mEventCount++;
-		}
-
-		for (j = 0; j <nNodes; j++ ) {
-			free(namelist[j]);
-		}
-
-		free(namelist);
-		mScanned = true;
-	}
-
-	/* Initialize data_path and data_fd */
-	for (j = 0; (j < mEventCount) && (j < MAX_SENSORS); j++) {
-		if (strcmp(list->sensor->name, event_list[j].data_name) == 0) {
-			strlcpy(event_path, event_list[j].data_path, PATH_MAX);
-			break;
-		}
-
-		if (strcmp(event_list[j].data_name, type_to_name(list->sensor->type)) == 0) {
-			strlcpy(event_path, event_list[j].data_path, PATH_MAX);
-		}
-	}
+	if (SensorInputIndex::lookup(list->sensor->name, event_path, PATH_MAX) == 0)
+		return 0;
 
-	return 0;
+	return SensorInputIndex::lookup(type_to_name(list->sensor->type), event_path, PATH_MAX);
 }
 
-int NativeSensorManager::getEventPath(const char *sysfs_path, char *event_path)
+/* Find the event node of the class device opened as dirfd from its input
+ * device parent. devname is only used in the messages.
+ */
+int NativeSensorManager::getEventPath(int dirfd, const char *devname, char *event_path)
 {
 	DIR *dir;
 	struct dirent *de;
 	char symlink[PATH_MAX];
 	int len;
+	int fd;
 	char *needle;
 
-	dir = opendir(sysfs_path);
-	if (dir == NULL) {
-		ALOGE("open %s failed.(%s)\n", strerror(errno));
-		return -1;
-	}
-	if ((sysfs_path == NULL) || (event_path == NULL)) {
+	if ((devname == NULL) || (event_path == NULL)) {
 		ALOGE("invalid NULL argument.");
 		return -EINVAL;
 	}
 
-	len = readlink(sysfs_path, symlink, PATH_MAX);
+	len = readlinkat(dirfd, "device", symlink, sizeof(symlink) - 1);
 	if (len < 0) {
-		ALOGE("readlink failed for %s(%s)\n", sysfs_path, strerror(errno));
+		ALOGE("readlink failed for %s(%s)\n", devname, strerror(errno));
 		return -1;
 	}
+	symlink[len] = '\0';
 
 	needle = strrchr(symlink, '/');
 	if (needle == NULL) {
@@ -624,7 +804,7 @@ int NativeSensorManager::getEventPath(const char *sysfs_path, char *event_path)
 	if (strncmp(needle + 1, "input", strlen("input")) != 0) {
 		ALOGE("\n");
 		ALOGE("==========================Notice=================================");
-		ALOGE("sensors_classdev %s need to register as the child of input device\n", sysfs_path);
+		ALOGE("sensors_classdev %s need to register as the child of input device\n", devname);
 		ALOGE("in order to speed up Android sensor service initialization time");
 		ALOGE("Please update your sensor driver.");
 		ALOGE("================================================================");
@@ -633,11 +813,24 @@ int NativeSensorManager::getEventPath(const char *sysfs_path, char *event_path)
 		return -ENODEV;
 	}
 
+	fd = openat(dirfd, "device", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		ALOGE("open %s/device failed.(%s)\n", devname, strerror(errno));
+		return -1;
+	}
+
+	dir = fdopendir(fd);
+	if (dir == NULL) {
+		ALOGE("open %s/device failed.(%s)\n", devname, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
 	strlcpy(event_path, EVENT_PATH, PATH_MAX);
 
 	while ((de = readdir(dir))) {
 		if (strncmp(de->d_name, "event", strlen("event")) == 0) {
-			strlcat(event_path, de->d_name, sizeof(de->d_name));
+			strlcat(event_path, de->d_name, PATH_MAX);
 			break;
 		}
 	}
@@ -647,86 +840,324 @@ int NativeSensorManager::getEventPath(const char *sysfs_path, char *event_path)
 	return 0;
 }
 
+/* Read the attributes of a class device. Runs on the discovery workers, so
+ * it touches nothing but the probe.
+ */
+void NativeSensorManager::probeSensor(int classfd, struct SensorProbe *probe)
+{
+	unsigned int i;
+	int fd;
+
+	probe->valid = false;
+	probe->sensor.name = probe->name;
+	probe->sensor.vendor = probe->vendor;
+
+	fd = openat(classfd, probe->entry, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		ALOGE("open %s%s failed.(%s)\n", SYSFS_CLASS, probe->entry, strerror(errno));
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(node_map); i++) {
+		if (getNode((char*)&probe->sensor, fd, node_map[i].node, &node_map[i]))
+			break;
+	}
+
+	if ((i == ARRAY_SIZE(node_map)) &&
+			((1ULL << probe->sensor.type) & SUPPORTED_SENSORS_TYPE)) {
+		probe->data_path[0] = '\0';
+		probe->event_err = getEventPath(fd, probe->entry, probe->data_path);
+		probe->valid = true;
+	}
+
+	close(fd);
+}
+
+void* NativeSensorManager::probeThread(void *arg)
+{
+	struct SensorProbeWork *work = (struct SensorProbeWork *)arg;
+	int i;
+
+	while ((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->count)
+		work->sm->probeSensor(work->classfd, &work->probe[i]);
+
+	return NULL;
+}
+
+#define FNV_BASIS 2166136261U
+#define FNV_PRIME 16777619U
+
+static uint32_t fnv_hash(uint32_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	while (len--)
+		hash = (hash ^ *p++) * FNV_PRIME;
+
+	return hash;
+}
+
+/* Fill the contexts from the discovery cache if it was written for the same
+ * build and class devices, and the event nodes still belong to the same
+ * input devices. Return the number of sensors, or -1 to probe them.
+ */
+int NativeSensorManager::loadCache(const char *file, uint32_t key)
+{
+	struct SensorCacheHeader hdr;
+	struct SensorCacheRecord *rec = NULL;
+	struct SensorContext *list;
+	char name[sizeof(rec->input_name)];
+	ssize_t size;
+	int ret = -1;
+	int fd;
+	int i;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		ALOGW_IF(errno != ENOENT, "open %s failed.(%s)\n", file, strerror(errno));
+		return -1;
+	}
+
+	if ((read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) ||
+			(hdr.magic != DISCOVERY_CACHE_MAGIC) ||
+			(hdr.version != DISCOVERY_CACHE_VERSION) || (hdr.key != key) ||
+			(hdr.count > (uint32_t)(mCapacity - MAX_VIRTUAL_SENSORS)))
+		goto out;
+
+	size = hdr.count * sizeof(*rec);
+	rec = new SensorCacheRecord[hdr.count];
+	if ((read(fd, rec, size) != size) || (fnv_hash(FNV_BASIS, rec, size) != hdr.sum)) {
+		ALOGW("%s is corrupted, probing the sensors\n", file);
+		goto out;
+	}
+
+	for (i = 0; i < (int)hdr.count; i++) {
+		rec[i].input_name[sizeof(rec[i].input_name) - 1] = '\0';
+		rec[i].data_path[PATH_MAX - 1] = '\0';
+		SensorInputIndex::getName(rec[i].data_path, name, sizeof(name));
+		if (strcmp(name, rec[i].input_name)) {
+			ALOGI("%s moved, probing the sensors\n", rec[i].data_path);
+			goto out;
+		}
+	}
+
+	for (i = 0; i < (int)hdr.count; i++) {
+		list = &context[i];
+		strlcpy(list->name, rec[i].name, sizeof(list->name));
+		strlcpy(list->vendor, rec[i].vendor, sizeof(list->vendor));
+		list->sensor->version = rec[i].version;
+		list->sensor->type = rec[i].type;
+		list->sensor->maxRange = rec[i].maxRange;
+		list->sensor->resolution = rec[i].resolution;
+		list->sensor->power = rec[i].power;
+		list->sensor->minDelay = rec[i].minDelay;
+		list->sensor->handle = SENSORS_HANDLE(i);
+
+		rec[i].enable_path[PATH_MAX - 1] = '\0';
+		list->enable_path = intern(rec[i].enable_path);
+		list->data_path = intern(rec[i].data_path);
+	}
+	ret = hdr.count;
+
+out:
+	delete [] rec;
+	close(fd);
+	return ret;
+}
+
+/* Write the discovered sensors to the cache, through a temporary file so a
+ * crash never leaves a partial cache behind.
+ */
+void NativeSensorManager::saveCache(const char *file, uint32_t key, int number)
+{
+	struct SensorCacheHeader hdr;
+	struct SensorCacheRecord *rec;
+	struct SensorContext *list;
+	char tmp[PATH_MAX];
+	ssize_t size = number * sizeof(*rec);
+	int fd;
+	int i;
+
+	rec = new SensorCacheRecord[number];
+	memset(rec, 0, size);
+
+	for (i = 0; i < number; i++) {
+		list = &context[i];
+		strlcpy(rec[i].name, list->name, sizeof(rec[i].name));
+		strlcpy(rec[i].vendor, list->vendor, sizeof(rec[i].vendor));
+		rec[i].version = list->sensor->version;
+		rec[i].type = list->sensor->type;
+		rec[i].maxRange = list->sensor->maxRange;
+		rec[i].resolution = list->sensor->resolution;
+		rec[i].power = list->sensor->power;
+		rec[i].minDelay = list->sensor->minDelay;
+		strlcpy(rec[i].enable_path, list->enable_path, PATH_MAX);
+		strlcpy(rec[i].data_path, list->data_path, PATH_MAX);
+		SensorInputIndex::getName(list->data_path, rec[i].input_name,
+				sizeof(rec[i].input_name));
+	}
+
+	hdr.magic = DISCOVERY_CACHE_MAGIC;
+	hdr.version = DISCOVERY_CACHE_VERSION;
+	hdr.key = key;
+	hdr.count = number;
+	hdr.sum = fnv_hash(FNV_BASIS, rec, size);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		ALOGW("create %s failed.(%s)\n", tmp, strerror(errno));
+		goto out;
+	}
+
+	if ((write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) || (write(fd, rec, size) != size) ||
+			fsync(fd)) {
+		ALOGW("write %s failed.(%s)\n", tmp, strerror(errno));
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+	close(fd);
+
+	if (rename(tmp, file)) {
+		ALOGW("rename %s failed.(%s)\n", tmp, strerror(errno));
+		unlink(tmp);
+	}
+
+out:
+	delete [] rec;
+}
+
+/* The class devices are probed concurrently by sensors.discovery.threads
+ * threads, the calling one included, as the sysfs reads are slow and
+ * get_sensors_list() is on the boot path. The handles are assigned in the
+ * directory order afterwards, so they don't depend on the scheduling.
+ * The result is kept in the sensors.discovery.cache file, and probing is
+ * skipped while the cache is valid, see DISCOVERY_CACHE.
+ */
 int NativeSensorManager::getSensorListInner()
 {
 	int number = 0;
-	int err = -1;
-	const char *dirname = SYSFS_CLASS;
-	char devname[PATH_MAX];
-	char *filename;
-	char *nodename;
+	int entries = 0;
+	int threads;
+	int started;
+	int cached;
+	int i;
+	uint32_t key;
 	DIR *dir;
 	struct dirent *de;
 	struct SensorContext *list;
-	unsigned int i;
+	struct SensorProbe *probe;
+	struct SensorProbeWork work;
+	pthread_t worker[MAX_DISCOVERY_THREADS];
+	char path[PATH_MAX];
+	char propBuf[PROPERTY_VALUE_MAX];
+	char cache[PROPERTY_VALUE_MAX];
 
-	dir = opendir(dirname);
+	dir = opendir(SYSFS_CLASS);
 	if(dir == NULL) {
+		allocRegistry(MAX_VIRTUAL_SENSORS);
 		return 0;
 	}
-	strlcpy(devname, dirname, PATH_MAX);
-	filename = devname + strlen(devname);
 
 	while ((de = readdir(dir))) {
-		if(de->d_name[0] == '.' &&
-			(de->d_name[1] == '\0' ||
-				(de->d_name[1] == '.' && de->d_name[2] == '\0')))
-			continue;
+		if (de->d_name[0] != '.')
+			entries++;
+	}
 
-		list = &context[number];
+	work.sm = this;
+	work.probe = new SensorProbe[entries];
+	work.count = 0;
+	work.next = 0;
+	work.classfd = dirfd(dir);
 
-		strlcpy(filename, de->d_name, PATH_MAX - strlen(SYSFS_CLASS));
-		nodename = filename + strlen(de->d_name);
-		*nodename++ = '/';
+	rewinddir(dir);
+	while ((de = readdir(dir)) && (work.count < entries)) {
+		if (de->d_name[0] != '.')
+			strlcpy(work.probe[work.count++].entry, de->d_name, sizeof(work.probe[0].entry));
+	}
 
-		for (i = 0; i < ARRAY_SIZE(node_map); i++) {
-			strlcpy(nodename, node_map[i].node, PATH_MAX - strlen(SYSFS_CLASS) - strlen(de->d_name));
-			err = getNode((char*)(list->sensor), devname, &node_map[i]);
-			if (err)
-				break;
+	/* At most one sensor per class device, plus the virtual ones */
+	allocRegistry(work.count + MAX_VIRTUAL_SENSORS);
+
+	/* The cache belongs to the build and the class devices it was written for */
+	property_get("ro.build.fingerprint", propBuf, "");
+	key = fnv_hash(FNV_BASIS, propBuf, strlen(propBuf) + 1);
+	for (i = 0; i < work.count; i++)
+		key = fnv_hash(key, work.probe[i].entry, strlen(work.probe[i].entry) + 1);
+
+	property_get("sensors.discovery.cache", cache, DISCOVERY_CACHE);
+	if (!strcmp(cache, "none"))
+		cache[0] = '\0';
+	if (cache[0] != '\0') {
+		cached = loadCache(cache, key);
+		if (cached >= 0) {
+			delete [] work.probe;
+			closedir(dir);
+			return cached;
 		}
+	}
 
-		if (i < ARRAY_SIZE(node_map))
-			continue;
+	property_get("sensors.discovery.threads", propBuf, "4");
+	threads = atoi(propBuf);
+	if (threads > MAX_DISCOVERY_THREADS)
+		threads = MAX_DISCOVERY_THREADS;
+	if (threads > work.count)
+		threads = work.count;
+
+	for (started = 1; started < threads; started++) {
+		if (pthread_create(&worker[started], NULL, probeThread, &work))
+			break;
+	}
+	probeThread(&work);
+	for (i = 1; i < started; i++)
+		pthread_join(worker[i], NULL);
 
-		if (!((1ULL << list->sensor->type) & SUPPORTED_SENSORS_TYPE))
+	for (i = 0; i < work.count; i++) {
+		probe = &work.probe[i];
+		if (!probe->valid)
 			continue;
 
+		list = &context[number];
+		*list->sensor = probe->sensor;
+		list->sensor->name = list->name;
+		list->sensor->vendor = list->vendor;
+		strlcpy(list->name, probe->name, sizeof(list->name));
+		strlcpy(list->vendor, probe->vendor, sizeof(list->vendor));
+
 		/* Setup other information */
 		list->sensor->handle = SENSORS_HANDLE(number);
 
-		strlcpy(nodename, "", SYSFS_MAXLEN);
-		strlcpy(list->enable_path, devname, PATH_MAX);
+		snprintf(path, sizeof(path), "%s%s/", SYSFS_CLASS, probe->entry);
+		list->enable_path = intern(path);
 
 		/* initialize data path */
-		strlcpy(nodename, "device", SYSFS_MAXLEN);
-
-		if (getEventPath(devname, list->data_path) == -ENODEV) {
-			getEventPathOld(list, list->data_path);
+		if (probe->event_err == -ENODEV) {
+			path[0] = '\0';
+			getEventPathOld(list, path);
+			list->data_path = intern(path);
+		} else {
+			list->data_path = intern(probe->data_path);
 		}
 
 		number++;
 	}
+
+	if (cache[0] != '\0')
+		saveCache(cache, key, number);
+
+	delete [] work.probe;
 	closedir(dir);
 	return number;
 }
 
-int NativeSensorManager::activate(int handle, int enable)
+/* Turn the sensor on or off for all the clients. Must be called with mLock held. */
+int NativeSensorManager::activateSensor(struct SensorContext *list, int enable)
 {
-	SensorContext *list;
-	int i;
-	int number = getSensorCount();
 	int err = 0;
 	struct listnode *node;
-	struct SensorContext *ctx;
 	struct SensorRefMap *item;
 
-	list = getInfoByHandle(handle);
-	if (list == NULL) {
-		ALOGE("Invalid handle(%d)", handle);
-		return -EINVAL;
-	}
-
 	/* Search for the background sensor for the sensor specified by handle. */
 	list_for_each(node, &list->dep_list) {
 		item = node_to_item(node, struct SensorRefMap, list);
@@ -735,6 +1166,9 @@ int NativeSensorManager::activate(int handle, int enable)
 			err = item->ctx->driver->enable(item->ctx->sensor->handle, 1);
 			if (!err) {
 				registerListener(item->ctx, list);
+				/* The driver may have queued an initial event */
+				if (item->ctx->reader != NULL)
+					item->ctx->reader->kick();
 			}
 		} else {
 			/* The background sensor has other listeners, we need
@@ -754,67 +1188,102 @@ int NativeSensorManager::activate(int handle, int enable)
 				item->ctx->driver->enable(item->ctx->sensor->handle, 0);
 			}
 		}
+		updateActiveMask(item->ctx);
+		publishSnapshot(item->ctx);
 	}
 
 	list->enable = enable;
+	if (!enable)
+		__atomic_add_fetch(&list->fifo_epoch, 1, __ATOMIC_RELEASE);
+	updateActiveMask(list);
+	publishSnapshot(list);
 
 	return err;
 }
 
-int NativeSensorManager::syncDelay(int handle)
+/* The lowest poll delay requested by the clients which enabled the sensor and
+ * by self, or 0 if none of them set one.
+ */
+int64_t NativeSensorManager::clientDelay(const struct SensorContext *list,
+		const struct SensorClient *self)
 {
-	const SensorRefMap *item;
-	SensorContext *ctx;
-	const SensorContext *list;
-	struct listnode *node;
-	int64_t min_ns;
+	const SensorClient *client;
+	int64_t min_ns = 0;
+	int i;
 
-	list = getInfoByHandle(handle);
-	if (list == NULL) {
-		ALOGE("Invalid handle(%d)", handle);
-		return -EINVAL;
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client = mClients[i];
+		if ((client == NULL) || ((client != self) && !clientEnabled(client, list->index)))
+			continue;
+		if ((client->delay_ns[list->index] > 0) &&
+				((min_ns == 0) || (client->delay_ns[list->index] < min_ns)))
+			min_ns = client->delay_ns[list->index];
 	}
 
-	if (list_empty(&list->listener)) {
-		min_ns = list->delay_ns;
-	} else {
-		node = list_head(&list->listener);
-		item = node_to_item(node, struct SensorRefMap, list);
-		min_ns = item->ctx->delay_ns;
+	return min_ns;
+}
 
-		list_for_each(node, &list->listener) {
-			item = node_to_item(node, struct SensorRefMap, list);
-			ctx = item->ctx;
-			/* To handle some special case that the polling delay is 0. This
-			 * may happen if the background sensor is not enabled but the virtual
-		         * sensor is enabled case.
-			 */
-			if (ctx->delay_ns == 0) {
-				ALOGW("Listener delay is 0. Fix it to minDelay");
-				ctx->delay_ns = ctx->sensor->minDelay;
-			}
+/* The lowest max report latency of the clients which enabled the sensor and of self */
+int64_t NativeSensorManager::clientLatency(const struct SensorContext *list,
+		const struct SensorClient *self)
+{
+	const SensorClient *client;
+	int64_t min_ns = -1;
+	int i;
 
-			if (min_ns > ctx->delay_ns)
-				min_ns = ctx->delay_ns;
-		}
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client = mClients[i];
+		if ((client == NULL) || ((client != self) && !clientEnabled(client, list->index)))
+			continue;
+		if ((min_ns < 0) || (client->latency_ns[list->index] < min_ns))
+			min_ns = client->latency_ns[list->index];
 	}
 
-	if ((list->delay_ns != 0) && (list->delay_ns < min_ns) &&
-			(list->enable))
-		min_ns = list->delay_ns;
-
-	return list->driver->setDelay(list->sensor->handle, min_ns);
+	return min_ns < 0 ? 0 : min_ns;
 }
 
-int NativeSensorManager::setDelay(int handle, int64_t ns)
+/* Arbitrate the hardware state of the sensor between the clients: it is on if
+ * any client enabled it, at the fastest rate and the shortest latency any of
+ * them asked for. Must be called with mLock held.
+ */
+int NativeSensorManager::applyClients(struct SensorContext *list)
 {
-	SensorContext *list;
+	int enable = 0;
+	int64_t delay_ns;
+	int err = 0;
 	int i;
-	int number = getSensorCount();
-	int64_t delay = ns;
-	struct SensorRefMap *item;
-	struct listnode *node;
 
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if ((mClients[i] != NULL) && clientEnabled(mClients[i], list->index))
+			enable = 1;
+	}
+
+	if (enable != list->enable) {
+		err = activateSensor(list, enable);
+		list->throttle_ns = 0;
+		/* The fastest sensor may be gone */
+		if (mHarmonic)
+			planRates();
+	}
+
+	if (enable) {
+		delay_ns = clientDelay(list, NULL);
+		if (delay_ns && (delay_ns != list->delay_ns))
+			setSensorDelay(list, delay_ns);
+		list->latency_ns = (list->fifo != NULL) ? clientLatency(list, NULL) : 0;
+	}
+
+	publishSnapshot(list);
+
+	return err;
+}
+
+int NativeSensorManager::activate(struct SensorClient *client, int handle, int enable)
+{
+	SensorContext *list;
+	int index;
+	int err;
+	Mutex::Autolock _l(mLock);
 
 	list = getInfoByHandle(handle);
 	if (list == NULL) {
@@ -822,76 +1291,1388 @@ int NativeSensorManager::setDelay(int handle, int64_t ns)
 		return -EINVAL;
 	}
 
-	list->delay_ns = delay;
+	index = list->index;
+	if (enable)
+		client->enable_mask[index / 32] |= 1U << (index % 32);
+	else
+		client->enable_mask[index / 32] &= ~(1U << (index % 32));
+	client->direct_mask[index / 32] &= ~(1U << (index % 32));
 
-	if (ns < list->sensor->minDelay) {
-		list->delay_ns = list->sensor->minDelay;
+	err = applyClients(list);
+	synchronizeSnapshots();
+
+	return err;
+}
+
+struct SensorClient* NativeSensorManager::registerClient()
+{
+	SensorClient *client;
+	int i;
+	Mutex::Autolock _l(mLock);
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if (mClients[i] == NULL)
+			break;
 	}
 
-	if (list->delay_ns == 0)
-		list->delay_ns = 1000000; //  clamped to 1ms
+	if (i == MAX_CLIENTS) {
+		ALOGE("Too many clients\n");
+		return NULL;
+	}
 
-	list_for_each(node, &list->dep_list) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		syncDelay(item->ctx->sensor->handle);
+	client = new SensorClient;
+	memset(client, 0, sizeof(*client));
+	client->id = i;
+	client->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (client->notify_fd < 0) {
+		ALOGE("error creating client eventfd (%s)", strerror(errno));
+		delete client;
+		return NULL;
 	}
+	client->queue = new SensorEventQueue(CLIENT_QUEUE_SIZE);
+	client->wake_queue = new SensorEventQueue(CLIENT_QUEUE_SIZE);
+	client->enable_mask = new uint32_t[mMaskWords]();
+	client->direct_mask = new uint32_t[mMaskWords]();
+	client->delay_ns = new int64_t[mCapacity]();
+	client->latency_ns = new int64_t[mCapacity]();
+	client->last_ns = new int64_t[mCapacity]();
 
-	return 0;
+	__atomic_store_n(&mClients[i], client, __ATOMIC_SEQ_CST);
+
+	return client;
 }
 
-int NativeSensorManager::readEvents(int handle, sensors_event_t* data, int count)
+void NativeSensorManager::unregisterClient(struct SensorClient *client)
 {
-	const SensorContext *list;
+	int i;
+
+	{
+		Mutex::Autolock _l(mLock);
+
+		for (i = 0; i < mSensorCount; i++) {
+			if (!clientEnabled(client, i))
+				continue;
+			client->enable_mask[i / 32] &= ~(1U << (i % 32));
+			client->direct_mask[i / 32] &= ~(1U << (i % 32));
+			applyClients(&context[i]);
+		}
+		/* The reader threads are done with the channel after this */
+		synchronizeSnapshots();
+
+		/* Make sure the poll path of the other clients is done with it */
+		Mutex::Autolock _r(mReadLock);
+		__atomic_store_n(&mClients[client->id], (SensorClient *)NULL, __ATOMIC_SEQ_CST);
+		for (i = 0; i < mSensorCount; i++) {
+			__atomic_sub_fetch(&context[i].flush_pending,
+					context[i].flush_client[client->id], __ATOMIC_RELEASE);
+			context[i].flush_client[client->id] = 0;
+		}
+	}
+
+	close(client->notify_fd);
+	delete client->channel;
+	delete client->wake_queue;
+	delete client->queue;
+	delete [] client->enable_mask;
+	delete [] client->direct_mask;
+	delete [] client->delay_ns;
+	delete [] client->latency_ns;
+	delete [] client->last_ns;
+	delete client;
+}
+
+void NativeSensorManager::notifyClient(struct SensorClient *client)
+{
+	const uint64_t msg = 1;
+	int result = write(client->notify_fd, &msg, sizeof(msg));
+	ALOGE_IF(result<0, "error notifying client (%s)", strerror(errno));
+}
+
+/* Drop the events coming faster than the client asked for, with some slack
+ * for the jitter of the sampling.
+ */
+bool NativeSensorManager::clientAccept(struct SensorClient *client, int index,
+		int64_t delay_ns, const sensors_event_t *event)
+{
+	if (event->timestamp - client->last_ns[index] < delay_ns - delay_ns / 8)
+		return false;
+
+	client->last_ns[index] = event->timestamp;
+	return true;
+}
+
+/* Hand the events read for list to every client which enabled it. The events
+ * for self are left in data, the others are queued for their clients.
+ * Returns the number of events left for self.
+ */
+int NativeSensorManager::dispatch(struct SensorClient *self, const struct SensorContext *list,
+		const struct SensorSnapshot *snap, sensors_event_t *data, int count)
+{
+	SensorClient *client;
+	SensorEventQueue *queue;
+	int64_t delay_ns;
+	int i, j, n;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client = mClients[i];
+		if (!(snap->client_mask & ~snap->direct_mask & (1U << i)) ||
+				(client == NULL) || (client == self))
+			continue;
+
+		/* No need to decimate for the client asking for the fastest rate */
+		delay_ns = snap->client_delay_ns[i] > snap->delay_ns ? snap->client_delay_ns[i] : 0;
+		queue = list->wake_up ? client->wake_queue : client->queue;
+		for (j = 0, n = 0; j < count; j++) {
+			if (delay_ns && !clientAccept(client, list->index, delay_ns, &data[j]))
+				continue;
+			/* The client queue is shared by the sensors of the
+			 * client, the poll path cannot block on it.
+			 */
+			if (list->overload != OVERLOAD_BLOCK) {
+				if (queue->overwrite(&data[j], 1)) {
+					client->dropped++;
+					countDropped(list, 1);
+				}
+				n++;
+			} else if (queue->write(&data[j], 1)) {
+				n++;
+			} else {
+				client->dropped++;
+				countDropped(list, 1);
+			}
+		}
+
+		if (n)
+			notifyClient(client);
+	}
+
+	if (!(snap->client_mask & ~snap->direct_mask & (1U << self->id)))
+		return 0;
+
+	delay_ns = snap->client_delay_ns[self->id] > snap->delay_ns ?
+		snap->client_delay_ns[self->id] : 0;
+	if (!delay_ns)
+		return count;
+
+	for (j = 0, n = 0; j < count; j++) {
+		if (clientAccept(self, list->index, delay_ns, &data[j]))
+			data[n++] = data[j];
+	}
+
+	return n;
+}
+
+/* Write the events of list to the direct channels of the clients which asked
+ * for them, or hand them to their callbacks. Called by whoever reads the
+ * sensor, under the RCU read lock.
+ */
+void NativeSensorManager::writeDirect(const struct SensorContext *list,
+		const struct SensorSnapshot *snap, const sensors_event_t *data, int count)
+{
+	SensorClient *client;
+	int64_t delay_ns;
 	int i, j;
-	int number = getSensorCount();
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client = mClients[i];
+		if (!(snap->direct_mask & (1U << i)) || (client == NULL))
+			continue;
+
+		if (client->callback != NULL) {
+			writeCallback(client, list, snap, data, count);
+			continue;
+		}
+		if (client->channel == NULL)
+			continue;
+
+		delay_ns = snap->client_delay_ns[i] > snap->delay_ns ? snap->client_delay_ns[i] : 0;
+		if (client->channel->isRaw()) {
+			if (list->has_raw)
+				writeRaw(client, list, delay_ns, data, count);
+			continue;
+		}
+		if (!delay_ns) {
+			client->channel->write(data, count);
+			continue;
+		}
+
+		for (j = 0; j < count; j++) {
+			if (clientAccept(client, list->index, delay_ns, &data[j]))
+				client->channel->write(&data[j], 1);
+		}
+	}
+}
+
+/* Write the events of list to the raw channel of client, turning their data
+ * back into the counts of the driver.
+ */
+void NativeSensorManager::writeRaw(struct SensorClient *client,
+		const struct SensorContext *list, int64_t delay_ns,
+		const sensors_event_t *data, int count)
+{
+	sensors_raw_frame_t frames[READER_BATCH_SIZE];
+	int i, j, n;
+
+	for (j = 0, n = 0; j < count; j++) {
+		if (delay_ns && !clientAccept(client, list->index, delay_ns, &data[j]))
+			continue;
+
+		frames[n].timestamp = data[j].timestamp;
+		frames[n].sensor = data[j].sensor;
+		for (i = 0; i < 3; i++) {
+			frames[n].value[i] = list->raw_scale[i] != 0 ?
+				lrintf(data[j].data[list->raw_field + i] / list->raw_scale[i]) : 0;
+		}
+
+		if (++n == ARRAY_SIZE(frames)) {
+			client->channel->write(frames, n);
+			n = 0;
+		}
+	}
+
+	if (n)
+		client->channel->write(frames, n);
+}
+
+/* Hand the events of list to the callback of client in as few calls as the
+ * decimation for its rate allows.
+ */
+void NativeSensorManager::writeCallback(struct SensorClient *client,
+		const struct SensorContext *list, const struct SensorSnapshot *snap,
+		const sensors_event_t *data, int count)
+{
+	int64_t delay_ns;
+	int start, j;
+
+	delay_ns = snap->client_delay_ns[client->id] > snap->delay_ns ?
+		snap->client_delay_ns[client->id] : 0;
+	if (!delay_ns) {
+		client->callback(client->cookie, data, count);
+		return;
+	}
+
+	/* Every run of accepted events is one batch */
+	for (start = 0, j = 0; j < count; j++) {
+		if (clientAccept(client, list->index, delay_ns, &data[j]))
+			continue;
+		if (j > start)
+			client->callback(client->cookie, &data[start], j - start);
+		start = j + 1;
+	}
+	if (count > start)
+		client->callback(client->cookie, &data[start], count - start);
+}
+
+/* Called by the reader thread of list. Returns false if no poll client and
+ * no listener needs the events anymore.
+ */
+bool NativeSensorManager::reportDirect(const struct SensorContext *list,
+		const sensors_event_t *data, int count)
+{
+	const SensorSnapshot *snap;
+	bool poll;
+	int phase;
+
+	phase = rcuReadLock();
+	snap = __atomic_load_n(&list->snapshot, __ATOMIC_SEQ_CST);
+	if (snap->direct_mask)
+		writeDirect(list, snap, data, count);
+	poll = (snap->client_mask & ~snap->direct_mask) || snap->listener_count;
+	rcuReadUnlock(phase);
+
+	return poll;
+}
+
+/* Called by the poll path of client only */
+int NativeSensorManager::readClientEvents(struct SensorClient *client,
+		sensors_event_t *data, int count)
+{
+	uint64_t msg;
 	int nb;
-	struct listnode *node;
+
+	read(client->notify_fd, &msg, sizeof(msg));
+	nb = client->wake_queue->read(data, count);
+	nb += client->queue->read(data + nb, count - nb);
+
+	/* Keep the notify fd readable while there are events left */
+	if (hasClientEvents(client))
+		notifyClient(client);
+
+	return nb;
+}
+
+/* A sensor is active if it is enabled by the framework or if any other
+ * sensor is listening on it. Only the active sensors can have pending events.
+ */
+void NativeSensorManager::updateActiveMask(const struct SensorContext *ctx)
+{
+	int index = ctx->index;
+
+	if (hasConsumers(ctx))
+		__atomic_or_fetch(&active_mask[index / 32], 1U << (index % 32), __ATOMIC_RELEASE);
+	else
+		__atomic_and_fetch(&active_mask[index / 32], ~(1U << (index % 32)), __ATOMIC_RELEASE);
+}
+
+void NativeSensorManager::getActiveMask(uint32_t *mask)
+{
+	for (int i = 0; i < mMaskWords; i++)
+		mask[i] = __atomic_load_n(&active_mask[i], __ATOMIC_ACQUIRE);
+}
+
+/* Build a new snapshot from the control state of ctx and swap it in. The old
+ * one is recycled by synchronizeSnapshots() once no reader can be using it.
+ * Must be called with mLock held.
+ */
+void NativeSensorManager::publishSnapshot(struct SensorContext *ctx)
+{
+	struct SensorSnapshot *snap;
+	struct SensorSnapshot *old;
 	struct SensorRefMap *item;
+	struct listnode *node;
+
+	/* Only the first changes allocate, then the snapshots are recycled */
+	snap = allocSnapshot();
+
+	snap->enable = ctx->enable;
+	snap->delay_ns = ctx->delay_ns;
+	snap->latency_ns = ctx->latency_ns;
+	snap->client_mask = 0;
+	snap->direct_mask = 0;
+	for (int i = 0; i < MAX_CLIENTS; i++) {
+		snap->client_delay_ns[i] = 0;
+		if ((mClients[i] == NULL) || !clientEnabled(mClients[i], ctx->index))
+			continue;
+		snap->client_mask |= 1U << i;
+		if (mClients[i]->direct_mask[ctx->index / 32] & (1U << (ctx->index % 32)))
+			snap->direct_mask |= 1U << i;
+		snap->client_delay_ns[i] = mClients[i]->delay_ns[ctx->index];
+	}
+	snap->listener_count = 0;
+	snap->next = NULL;
+	/* A hardware sensor enabled for itself is on its own listener list, it
+	 * has nothing to be fed with though.
+	 */
+	list_for_each(node, &ctx->listener) {
+		item = node_to_item(node, struct SensorRefMap, list);
+		if (item->ctx != ctx)
+			snap->listener[snap->listener_count++] = item->ctx;
+	}
+
+	old = __atomic_exchange_n(&ctx->snapshot, snap, __ATOMIC_SEQ_CST);
+	if (old != NULL) {
+		old->next = mRetired;
+		mRetired = old;
+	}
+}
+
+/* Wait until the readers which may still see the retired snapshots are gone.
+ * New readers are counted on the other phase, so this can not be starved by
+ * a busy poll thread. Must be called with mLock held.
+ */
+void NativeSensorManager::synchronizeSnapshots()
+{
+	struct SensorSnapshot *snap;
+	int32_t phase;
+
+	if (mRetired == NULL)
+		return;
+
+	phase = __atomic_load_n(&mRcuPhase, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&mRcuPhase, !phase, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&mRcuReaders[phase], __ATOMIC_SEQ_CST))
+		sched_yield();
+
+	while (mRetired != NULL) {
+		snap = mRetired;
+		mRetired = snap->next;
+		snap->next = mSnapshotFree;
+		mSnapshotFree = snap;
+	}
+}
+
+/* The poll delay currently requested for ctx, safe to call from the poll path */
+int64_t NativeSensorManager::getDelay(const struct SensorContext *ctx)
+{
+	int phase = rcuReadLock();
+	int64_t delay_ns = __atomic_load_n(&ctx->snapshot, __ATOMIC_SEQ_CST)->delay_ns;
+
+	rcuReadUnlock(phase);
+	return delay_ns;
+}
+
+/* Count the reader on the current phase. If the phase flipped before the
+ * reader was counted, synchronizeSnapshots() may already have found the old
+ * phase empty, so the reader moves to the new one.
+ */
+int NativeSensorManager::rcuReadLock()
+{
+	int phase;
+
+	for (;;) {
+		phase = __atomic_load_n(&mRcuPhase, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&mRcuReaders[phase], 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&mRcuPhase, __ATOMIC_SEQ_CST) == phase)
+			return phase;
+		__atomic_sub_fetch(&mRcuReaders[phase], 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+void NativeSensorManager::rcuReadUnlock(int phase)
+{
+	__atomic_sub_fetch(&mRcuReaders[phase], 1, __ATOMIC_SEQ_CST);
+}
+
+int NativeSensorManager::syncDelay(int handle)
+{
+	const SensorRefMap *item;
+	SensorContext *ctx;
+	SensorContext *list;
+	struct listnode *node;
+	int64_t min_ns;
 
 	list = getInfoByHandle(handle);
 	if (list == NULL) {
 		ALOGE("Invalid handle(%d)", handle);
 		return -EINVAL;
 	}
-	do {
-                if (list->driver == NULL) {
-                        ALOGE("Invalid sensor handle is %d",handle);
-                        return -EINVAL;
-                }
-		nb = list->driver->readEvents(data, count);
-	} while ((nb == -EAGAIN) || (nb == -EINTR));
 
-	for (j = 0; j < nb; j++) {
+	if (list_empty(&list->listener)) {
+		min_ns = list->delay_ns;
+	} else {
+		node = list_head(&list->listener);
+		item = node_to_item(node, struct SensorRefMap, list);
+		min_ns = item->ctx->delay_ns;
+
 		list_for_each(node, &list->listener) {
 			item = node_to_item(node, struct SensorRefMap, list);
-			if (item->ctx->enable) {
-                                if (item->ctx->driver == NULL) {
-                                        ALOGE("Invalid sensor");
-                                        return -EINVAL;
-                                }
-				item->ctx->driver->injectEvents(&data[j], 1);
+			ctx = item->ctx;
+			/* To handle some special case that the polling delay is 0. This
+			 * may happen if the background sensor is not enabled but the virtual
+		         * sensor is enabled case.
+			 */
+			if (ctx->delay_ns == 0) {
+				ALOGW("Listener delay is 0. Fix it to minDelay");
+				ctx->delay_ns = ctx->sensor->minDelay;
 			}
+
+			if (min_ns > ctx->delay_ns)
+				min_ns = ctx->delay_ns;
 		}
 	}
 
-	if (list->enable)
-		return nb;
+	if ((list->delay_ns != 0) && (list->delay_ns < min_ns) &&
+			(list->enable))
+		min_ns = list->delay_ns;
+
+	list->request_ns = min_ns;
 
-	/* No need to report the events if the sensor is not enabled */
-	return 0;
+	return applyRate(list);
 }
 
-int NativeSensorManager::hasPendingEvents(int handle)
+/* The poll delay the driver should run at, the throttled one if slower */
+static int64_t rate_delay(const struct SensorContext *ctx)
 {
-	const SensorContext *list;
+	return ctx->throttle_ns > ctx->request_ns ? ctx->throttle_ns : ctx->request_ns;
+}
 
-	list = getInfoByHandle(handle);
-	if (list == NULL) {
-		ALOGE("Invalid handle(%d)", handle);
-		return -EINVAL;
+/* Write the poll delay of the sensor to its driver. Must be called with mLock held. */
+int NativeSensorManager::applyRate(struct SensorContext *list)
+{
+	int64_t delay_ns = rate_delay(list);
+	int err;
+
+	if (mHarmonic)
+		return planRates();
+
+	err = list->driver->setDelay(list->sensor->handle, delay_ns);
+	if (!err)
+		list->applied_ns = delay_ns;
+
+	return err;
+}
+
+/* The longest base * 2^k which is not longer than delay_ns */
+static int64_t harmonic_delay(int64_t base, int64_t delay_ns)
+{
+	int64_t d = base;
+
+	if ((base <= 0) || (delay_ns <= base))
+		return delay_ns;
+
+	while (d * 2 <= delay_ns)
+		d *= 2;
+
+	return d;
+}
+
+/* Snap the poll delay of every active hardware sensor to a power of two
+ * multiple of the fastest one, never slower than it needs, so that their
+ * samples arrive together and are delivered by the same poll() return.
+ * Must be called with mLock held.
+ */
+int NativeSensorManager::planRates()
+{
+	SensorContext *ctx;
+	int64_t base = 0;
+	int64_t delay_ns;
+	int err = 0;
+	int ret;
+	int i;
+
+	for (i = 0; i < mSensorCount; i++) {
+		ctx = &context[i];
+		if (ctx->is_virtual || (ctx->driver == NULL) || (ctx->request_ns <= 0) ||
+				!hasConsumers(ctx))
+			continue;
+		if (!base || (rate_delay(ctx) < base))
+			base = rate_delay(ctx);
 	}
 
-	return list->driver->hasPendingEvents();
+	for (i = 0; i < mSensorCount; i++) {
+		ctx = &context[i];
+		/* The idle sensors get their rate when they are enabled again */
+		if (ctx->is_virtual || (ctx->driver == NULL) || (ctx->request_ns <= 0) ||
+				!hasConsumers(ctx))
+			continue;
+
+		delay_ns = harmonic_delay(base, rate_delay(ctx));
+		if (delay_ns == ctx->applied_ns)
+			continue;
+
+		ret = ctx->driver->setDelay(ctx->sensor->handle, delay_ns);
+		if (ret) {
+			if (!err)
+				err = ret;
+			continue;
+		}
+		ctx->applied_ns = delay_ns;
+	}
+
+	return err;
+}
+
+/* The longest poll delay still asked for by the clients and the listeners of
+ * the sensor. Must be called with mLock held.
+ */
+int64_t NativeSensorManager::slowestDelay(const struct SensorContext *list)
+{
+	const struct SensorRefMap *item;
+	struct listnode *node;
+	int64_t max_ns = list->request_ns;
+	int i;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if ((mClients[i] == NULL) || !clientEnabled(mClients[i], list->index))
+			continue;
+		if (mClients[i]->delay_ns[list->index] > max_ns)
+			max_ns = mClients[i]->delay_ns[list->index];
+	}
+
+	list_for_each(node, &list->listener) {
+		item = node_to_item(node, struct SensorRefMap, list);
+		if (item->ctx->enable && (item->ctx->delay_ns > max_ns))
+			max_ns = item->ctx->delay_ns;
+	}
+
+	return max_ns;
+}
+
+/* Lower the rate of the hardware sensors whose events get lost because the
+ * consumers drain them slower than they are produced, never below the slowest
+ * rate still asked for, and bring it back up once they keep up. Called from
+ * the poll path, so the check is skipped rather than waiting on the control
+ * path.
+ */
+void NativeSensorManager::adaptRates(int64_t now)
+{
+	const struct SensorRefMap *item;
+	struct SensorContext *list;
+	struct listnode *node;
+	uint32_t produced, lost, p, l;
+	int64_t delay_ns, slowest_ns;
+	int i;
+
+	if (!mBackpressure ||
+			(now - __atomic_load_n(&mBackpressureTime, __ATOMIC_RELAXED) <
+			 BACKPRESSURE_INTERVAL_NS))
+		return;
+
+	if (mLock.tryLock())
+		return;
+	if (now - mBackpressureTime < BACKPRESSURE_INTERVAL_NS) {
+		mLock.unlock();
+		return;
+	}
+	__atomic_store_n(&mBackpressureTime, now, __ATOMIC_RELAXED);
+
+	for (i = 0; i < mSensorCount; i++) {
+		list = &context[i];
+		if (list->is_virtual || (list->driver == NULL) || !hasConsumers(list) ||
+				(list->request_ns <= 0))
+			continue;
+
+		/* The events derived from this sensor by its listeners count too */
+		produced = __atomic_load_n(&list->produced, __ATOMIC_RELAXED);
+		lost = getDropCount(list) + __atomic_load_n(&list->stalled, __ATOMIC_RELAXED);
+		list_for_each(node, &list->listener) {
+			item = node_to_item(node, struct SensorRefMap, list);
+			lost += getDropCount(item->ctx);
+		}
+
+		p = produced - list->seen_produced;
+		l = lost - list->seen_lost;
+		list->seen_produced = produced;
+		list->seen_lost = lost;
+
+		delay_ns = list->throttle_ns;
+		if (p && (l * BACKPRESSURE_SLACK > p)) {
+			/* Produce no faster than the consumers drained */
+			delay_ns = rate_delay(list);
+			delay_ns = (l >= p) ? delay_ns * 2 : delay_ns * p / (p - l);
+			slowest_ns = slowestDelay(list);
+			if (delay_ns > slowest_ns)
+				delay_ns = slowest_ns;
+		} else if (delay_ns && !l) {
+			/* Caught up, go halfway back to the rate asked for */
+			delay_ns = (delay_ns + list->request_ns) / 2;
+			if (delay_ns - list->request_ns < list->request_ns / BACKPRESSURE_SLACK)
+				delay_ns = 0;
+		}
+
+		if (delay_ns <= list->request_ns)
+			delay_ns = 0;
+		if (delay_ns == list->throttle_ns)
+			continue;
+
+		ALOGI("%s poll delay %lld ns for its consumers, %lld ns asked for",
+				list->sensor->name,
+				(long long)(delay_ns ? delay_ns : list->request_ns),
+				(long long)list->request_ns);
+		list->throttle_ns = delay_ns;
+		applyRate(list);
+	}
+
+	mLock.unlock();
+}
+
+/* Set the poll delay of the sensor for all the clients. Must be called with mLock held. */
+int NativeSensorManager::setSensorDelay(struct SensorContext *list, int64_t ns)
+{
+	int64_t delay = ns;
+	struct SensorRefMap *item;
+	struct listnode *node;
+
+	list->delay_ns = delay;
+
+	if (ns < list->sensor->minDelay) {
+		list->delay_ns = list->sensor->minDelay;
+	}
+
+	if (list->delay_ns == 0)
+		list->delay_ns = 1000000; //  clamped to 1ms
+
+	list_for_each(node, &list->dep_list) {
+		item = node_to_item(node, struct SensorRefMap, list);
+		syncDelay(item->ctx->sensor->handle);
+		publishSnapshot(item->ctx);
+	}
+
+	publishSnapshot(list);
+
+	return 0;
+}
+
+int NativeSensorManager::setDelay(struct SensorClient *client, int handle, int64_t ns)
+{
+	SensorContext *list;
+	int64_t delay_ns;
+	Mutex::Autolock _l(mLock);
+
+	list = getInfoByHandle(handle);
+	if (list == NULL) {
+		ALOGE("Invalid handle(%d)", handle);
+		return -EINVAL;
+	}
+
+	client->delay_ns[list->index] = ns;
+	delay_ns = clientDelay(list, client);
+	setSensorDelay(list, delay_ns ? delay_ns : ns);
+	synchronizeSnapshots();
+
+	return 0;
+}
+
+/* Read the events of a sensor from its driver and feed its listeners */
+int NativeSensorManager::readDriver(const struct SensorContext *list,
+		const struct SensorSnapshot *snap, sensors_event_t* data, int count)
+{
+	const SensorContext *ctx;
+	int i;
+	int nb;
+
+	if (list->reader != NULL) {
+		/* The events are already decoded by the reader thread */
+		nb = list->reader->readEvents(data, count);
+	} else {
+		if (list->driver == NULL) {
+			ALOGE("Invalid sensor handle is %d", list->sensor->handle);
+			return -EINVAL;
+		}
+		do {
+			nb = list->driver->readEvents(data, count);
+		} while (nb == -EINTR);
+
+		/* Nothing to read, this happens if we are only here for a flush */
+		if (nb == -EAGAIN)
+			nb = 0;
+
+		/* The reader thread does it for the sensors having one */
+		if ((nb > 0) && snap->direct_mask)
+			writeDirect(list, snap, data, nb);
+
+		/* The events are out of the kernel, which let the AP sleep again */
+		if ((nb > 0) && list->wake_up)
+			holdWakeLock();
+
+		if (nb > 0)
+			__atomic_fetch_add(&list->produced, nb, __ATOMIC_RELAXED);
+	}
+
+	/* The whole batch goes to every listener at once */
+	for (i = 0; (nb > 0) && (i < snap->listener_count); i++) {
+		ctx = snap->listener[i];
+		if (!__atomic_load_n(&ctx->snapshot, __ATOMIC_SEQ_CST)->enable)
+			continue;
+		if (ctx->driver == NULL) {
+			ALOGE("Invalid sensor");
+			return -EINVAL;
+		}
+		ctx->driver->injectEvents(data, nb);
+	}
+
+	/* No need to report the events if the sensor is not enabled */
+	if (!snap->enable)
+		return 0;
+
+	return nb;
+}
+
+bool NativeSensorManager::batchExpired(const struct SensorContext *list,
+		const struct SensorSnapshot *snap, int64_t now)
+{
+	int64_t batch_start = __atomic_load_n(&list->batch_start_ns, __ATOMIC_ACQUIRE);
+
+	return (snap->latency_ns == 0) ||
+		__atomic_load_n(&list->flush_pending, __ATOMIC_ACQUIRE) ||
+		(batch_start <= __atomic_load_n(&mBatchRelease, __ATOMIC_ACQUIRE)) ||
+		(now - batch_start >= snap->latency_ns);
+}
+
+/* Deliver the batches queued up to now. Several poll contexts may race here. */
+void NativeSensorManager::releaseBatches(int64_t now)
+{
+	int64_t release = __atomic_load_n(&mBatchRelease, __ATOMIC_ACQUIRE);
+
+	while ((release < now) && !__atomic_compare_exchange_n(&mBatchRelease, &release,
+				now, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+		;
+}
+
+/* Hold the events in the software FIFO until the max report latency expires,
+ * the FIFO is full or a flush is requested, then deliver them in one burst.
+ */
+int NativeSensorManager::readBatch(struct SensorContext *list,
+		const struct SensorSnapshot *snap, sensors_event_t* data, int count)
+{
+	SensorEventQueue *fifo = list->fifo;
+	int64_t now = SensorBase::getTimestamp();
+	int32_t epoch = __atomic_load_n(&list->fifo_epoch, __ATOMIC_ACQUIRE);
+	int space;
+	int nb;
+
+	/* The sensor was deactivated since these events were batched */
+	if (list->fifo_seen_epoch != epoch) {
+		fifo->clear();
+		list->fifo_seen_epoch = epoch;
+	}
+
+	space = list->sensor->fifoMaxEventCount - fifo->available();
+
+	if (space > 0) {
+		nb = readDriver(list, snap, data, count < space ? count : space);
+		if (nb < 0)
+			return nb;
+
+		if (nb && !fifo->available())
+			__atomic_store_n(&list->batch_start_ns, now, __ATOMIC_RELEASE);
+		fifo->write(data, nb);
+	}
+
+	/* A FIFO reaching its watermark releases the batches of all the sensors
+	 * so that they go out in the same poll() return. */
+	if (fifo->available() >= (int)list->sensor->fifoMaxEventCount * mWatermark / 100)
+		releaseBatches(now);
+
+	if (batchExpired(list, snap, now))
+		return fifo->read(data, count);
+
+	return 0;
+}
+
+/* Report the flush complete events to the clients which asked for them, once
+ * the batched events are delivered. Returns the number of events left for self.
+ */
+int NativeSensorManager::reportFlush(struct SensorClient *self, struct SensorContext *list,
+		sensors_event_t* data, int count)
+{
+	SensorClient *client;
+	sensors_event_t event;
+	int nb = 0;
+	int pending;
+	int i, j;
+
+	if (!__atomic_load_n(&list->flush_pending, __ATOMIC_ACQUIRE) ||
+			((list->fifo != NULL) && list->fifo->available()))
+		return 0;
+
+	memset(&event, 0, sizeof(event));
+	event.version = META_DATA_VERSION;
+	event.type = SENSOR_TYPE_META_DATA;
+	event.sensor = 0;
+	event.timestamp = 0;
+	event.meta_data.what = META_DATA_FLUSH_COMPLETE;
+	event.meta_data.sensor = list->sensor->handle;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		pending = __atomic_load_n(&list->flush_client[i], __ATOMIC_ACQUIRE);
+		client = mClients[i];
+		if (!pending || (client == NULL))
+			continue;
+
+		if (client == self) {
+			if (pending > count - nb)
+				pending = count - nb;
+			for (j = 0; j < pending; j++)
+				data[nb++] = event;
+		} else {
+			for (j = 0; j < pending; j++) {
+				if (!(list->wake_up ? client->wake_queue : client->queue)->write(&event, 1))
+					break;
+			}
+			pending = j;
+			if (pending)
+				notifyClient(client);
+		}
+
+		__atomic_sub_fetch(&list->flush_client[i], pending, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&list->flush_pending, pending, __ATOMIC_RELEASE);
+	}
+
+	return nb;
+}
+
+int NativeSensorManager::readEvents(struct SensorClient *client, int handle,
+		sensors_event_t* data, int count)
+{
+	SensorContext *list;
+	const SensorSnapshot *snap;
+	int nb;
+	int phase;
+
+	list = getInfoByHandle(handle);
+	if (list == NULL) {
+		ALOGE("Invalid handle(%d)", handle);
+		return -EINVAL;
+	}
+
+	/* Whoever reads the sensor hands the events to all the clients. The
+	 * lock is global because the client queues have a single producer.
+	 */
+	Mutex::Autolock _r(mReadLock);
+
+	/* The control path may change the listeners concurrently, so only look
+	 * at them through the snapshot. */
+	phase = rcuReadLock();
+	snap = __atomic_load_n(&list->snapshot, __ATOMIC_SEQ_CST);
+
+	if ((list->fifo != NULL) && (snap->latency_ns || list->fifo->available()))
+		nb = readBatch(list, snap, data, count);
+	else
+		nb = readDriver(list, snap, data, count);
+
+	if (nb > 0)
+		nb = dispatch(client, list, snap, data, nb);
+
+	if (nb >= 0)
+		nb += reportFlush(client, list, data + nb, count - nb);
+
+	rcuReadUnlock(phase);
+
+	return nb;
+}
+
+int NativeSensorManager::hasPendingEvents(int handle)
+{
+	const SensorContext *list;
+
+	list = getInfoByHandle(handle);
+	if (list == NULL) {
+		ALOGE("Invalid handle(%d)", handle);
+		return -EINVAL;
+	}
+
+	if (__atomic_load_n(&list->flush_pending, __ATOMIC_ACQUIRE))
+		return 1;
+
+	if ((list->fifo != NULL) && list->fifo->available()) {
+		int phase = rcuReadLock();
+		bool expired = batchExpired(list, __atomic_load_n(&list->snapshot, __ATOMIC_SEQ_CST),
+				SensorBase::getTimestamp());
+
+		rcuReadUnlock(phase);
+		if (expired)
+			return 1;
+	}
+
+	if (list->reader != NULL)
+		return list->reader->hasPendingEvents();
+
+	if ((mUring != NULL) && (list->data_fd >= 0) && mUring->hasData(list->data_fd))
+		return 1;
+
+	return list->driver->hasPendingEvents();
+}
+
+/* Read the event devices of the sensors without a reader thread through an
+ * io_uring if sensors.io.uring is set. Keep using read(2) if the kernel does
+ * not support it.
+ */
+void NativeSensorManager::initUring()
+{
+	char propBuf[PROPERTY_VALUE_MAX];
+	int *slot;
+	int i;
+
+	property_get("sensors.io.uring", propBuf, "0");
+	if (strcmp(propBuf, "1"))
+		return;
+
+	mUring = new SensorUring(mSensorCount);
+	slot = new int[mSensorCount];
+	for (i = 0; i < mSensorCount; i++) {
+		slot[i] = -1;
+		if (context[i].is_virtual || (context[i].reader != NULL) ||
+				(context[i].driver == NULL) || (context[i].data_fd < 0))
+			continue;
+		slot[i] = mUring->addSensor(&context[i]);
+		if (slot[i] < 0)
+			ALOGW("%s is not read with io_uring\n", context[i].sensor->name);
+	}
+
+	/* Deleting the ring gives the fds their O_NONBLOCK back */
+	if (mUring->start()) {
+		ALOGW("Fall back to read(2) for the sensor events\n");
+		delete mUring;
+		mUring = NULL;
+	} else {
+		/* Only the drivers of the sensors in the ring read through it */
+		for (i = 0; i < mSensorCount; i++) {
+			if (slot[i] >= 0)
+				context[i].driver->setUring(mUring, slot[i]);
+		}
+	}
+
+	delete [] slot;
+}
+
+/* Collect the sensors whose read completed, and which were not read yet */
+int NativeSensorManager::harvestReads(struct SensorContext **ready, int count)
+{
+	Mutex::Autolock _r(mReadLock);
+
+	return mUring->harvest(ready, count);
+}
+
+/* Resubmit the reads of the sensors read since the last call */
+void NativeSensorManager::submitReads()
+{
+	Mutex::Autolock _r(mReadLock);
+
+	mUring->submit();
+}
+
+/* Build the property key prefix<token> of the type of ctx into prop, which
+ * holds PROPERTY_KEY_MAX characters. A key that does not fit is left empty,
+ * so that looking it up returns the default.
+ */
+static void sensor_prop_key(char *prop, const char *prefix, const struct SensorContext *ctx)
+{
+	int len = snprintf(prop, PROPERTY_KEY_MAX, "%s%s", prefix, type_to_token(ctx->sensor->type));
+
+	if (len >= PROPERTY_KEY_MAX) {
+		ALOGW("property %s%s of %s is too long, ignored\n", prefix,
+				type_to_token(ctx->sensor->type), ctx->sensor->name);
+		prop[0] = '\0';
+	}
+}
+
+/* Classify the sensor as wake-up or not: the proximity sensor is a wake-up
+ * sensor, which the wakeup sysfs node of the sensor or sensors.wakeup.<token>
+ * can override. The virtual sensors never wake up. Also fills the fields of
+ * sensor_t added by HAL 1.3, for all the sensors.
+ */
+void NativeSensorManager::initFlags(struct SensorContext *ctx)
+{
+	char path[PATH_MAX];
+	char prop[PROPERTY_KEY_MAX];
+	char propBuf[PROPERTY_VALUE_MAX];
+	struct SysfsMap map = {0, SYSFS_WAKEUP, TYPE_INTEGER};
+	int wake_up = (ctx->sensor->type == SENSOR_TYPE_PROXIMITY);
+
+	if (ctx->is_virtual) {
+		ctx->wake_up = false;
+	} else {
+		snprintf(path, sizeof(path), "%s%s", ctx->enable_path, SYSFS_WAKEUP);
+		if (!access(path, R_OK))
+			getNode((char *)&wake_up, AT_FDCWD, path, &map);
+
+		sensor_prop_key(prop, "sensors.wakeup.", ctx);
+		property_get(prop, propBuf, wake_up ? "1" : "0");
+		ctx->wake_up = (strcmp(propBuf, "1") == 0);
+	}
+
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+	ctx->sensor->stringType = type_to_string(ctx->sensor->type);
+	ctx->sensor->requiredPermission = "";
+	ctx->sensor->maxDelay = SENSOR_MAX_DELAY_US;
+
+	switch (ctx->sensor->type) {
+		case SENSOR_TYPE_LIGHT:
+		case SENSOR_TYPE_PROXIMITY:
+			ctx->sensor->flags = SENSOR_FLAG_ON_CHANGE_MODE;
+			break;
+		default:
+			ctx->sensor->flags = SENSOR_FLAG_CONTINUOUS_MODE;
+			break;
+	}
+
+	if (ctx->wake_up)
+		ctx->sensor->flags |= SENSOR_FLAG_WAKE_UP;
+#endif
+}
+
+/* Pick what happens to the events of the sensor when its consumer falls
+ * behind: the on-change sensors keep their latest event only, the others
+ * drop the oldest events. sensors.overload.<token> can override it with
+ * drop_oldest, keep_latest or block.
+ */
+void NativeSensorManager::initOverload(struct SensorContext *ctx)
+{
+	char prop[PROPERTY_KEY_MAX];
+	char propBuf[PROPERTY_VALUE_MAX];
+	const char *def;
+
+	switch (ctx->sensor->type) {
+		case SENSOR_TYPE_LIGHT:
+		case SENSOR_TYPE_PROXIMITY:
+			def = "keep_latest";
+			break;
+		default:
+			def = "drop_oldest";
+			break;
+	}
+
+	sensor_prop_key(prop, "sensors.overload.", ctx);
+	property_get(prop, propBuf, def);
+
+	if (!strcmp(propBuf, "keep_latest")) {
+		ctx->overload = OVERLOAD_KEEP_LATEST;
+	} else if (!strcmp(propBuf, "block")) {
+		ctx->overload = OVERLOAD_BLOCK;
+	} else {
+		ALOGE_IF(strcmp(propBuf, "drop_oldest"), "unknown overload policy %s for %s",
+				propBuf, ctx->sensor->name);
+		ctx->overload = OVERLOAD_DROP_OLDEST;
+	}
+}
+
+/* Account events of ctx lost to its overload policy. Called from any thread,
+ * logs at every power of two so that a slow consumer does not flood the log.
+ */
+void NativeSensorManager::countDropped(const struct SensorContext *ctx, int count)
+{
+	uint32_t before = __atomic_fetch_add(&ctx->dropped, count, __ATOMIC_RELAXED);
+	uint32_t after = before + count;
+
+	/* The highest bit changed on the way */
+	if ((before ^ after) > before)
+		ALOGW("%s is overloaded, %u events dropped\n", ctx->sensor->name, after);
+}
+
+/* Replace the wakelock implementation, the manager owns it afterwards */
+void NativeSensorManager::setWakeLock(SensorWakeLock *wakelock)
+{
+	Mutex::Autolock _l(mWakeLockLock);
+
+	if (mWakeLockHeld) {
+		mWakeLock->release();
+		wakelock->acquire();
+	}
+
+	delete mWakeLock;
+	mWakeLock = wakelock;
+}
+
+/* Keep the AP awake until the poll path sees no wake-up event pending */
+void NativeSensorManager::holdWakeLock()
+{
+	Mutex::Autolock _l(mWakeLockLock);
+
+	__atomic_add_fetch(&mWakeSeq, 1, __ATOMIC_RELEASE);
+	if (!mWakeLockHeld) {
+		mWakeLock->acquire();
+		__atomic_store_n(&mWakeLockHeld, true, __ATOMIC_RELEASE);
+	}
+}
+
+/* Release the wakelock unless it was asked for again since seq was read */
+void NativeSensorManager::releaseWakeLock(uint32_t seq)
+{
+	Mutex::Autolock _l(mWakeLockLock);
+
+	if (mWakeLockHeld && (seq == mWakeSeq)) {
+		mWakeLock->release();
+		__atomic_store_n(&mWakeLockHeld, false, __ATOMIC_RELEASE);
+	}
+}
+
+/* If any wake-up event read from the kernel is not returned by poll() yet */
+bool NativeSensorManager::hasWakeEvents()
+{
+	const SensorContext *ctx;
+	SensorClient *client;
+	int i;
+
+	for (i = 0; i < mSensorCount; i++) {
+		ctx = &context[i];
+		if (!ctx->wake_up)
+			continue;
+		if (__atomic_load_n(&ctx->flush_pending, __ATOMIC_ACQUIRE) ||
+				((ctx->reader != NULL) && ctx->reader->hasPendingEvents()) ||
+				((ctx->fifo != NULL) && ctx->fifo->available()))
+			return true;
+	}
+
+	/* The clients are only freed with mReadLock held */
+	Mutex::Autolock _r(mReadLock);
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client = mClients[i];
+		if ((client != NULL) && client->wake_queue->available())
+			return true;
+	}
+
+	return false;
+}
+
+/* Size the software FIFO of a sensor from sensors.fifo.<token>, falling back to
+ * sensors.fifo.size. The FIFO is allocated here, before the poll path can see
+ * the sensor, so that the pointer never changes under its lock-free readers.
+ */
+void NativeSensorManager::initFifo(struct SensorContext *ctx)
+{
+	char prop[PROPERTY_KEY_MAX];
+	char propBuf[PROPERTY_VALUE_MAX];
+	char def[PROPERTY_VALUE_MAX];
+	char size[PROPERTY_VALUE_MAX];
+
+	snprintf(def, sizeof(def), "%d", DEFAULT_FIFO_SIZE);
+	property_get("sensors.fifo.size", size, def);
+	sensor_prop_key(prop, "sensors.fifo.", ctx);
+	property_get(prop, propBuf, size);
+
+	ctx->sensor->fifoReservedEventCount = 0;
+	ctx->sensor->fifoMaxEventCount = atoi(propBuf) > 0 ? atoi(propBuf) : 0;
+	if (ctx->sensor->fifoMaxEventCount)
+		ctx->fifo = new SensorEventQueue(ctx->sensor->fifoMaxEventCount);
+}
+
+int NativeSensorManager::batch(struct SensorClient *client, int handle, int flags,
+		int64_t period_ns, int64_t timeout)
+{
+	SensorContext *list;
+	int64_t delay_ns;
+
+	list = getInfoByHandle(handle);
+	if (list == NULL) {
+		ALOGE("Invalid handle(%d)", handle);
+		return -EINVAL;
+	}
+
+	/* Batching is not possible without a FIFO */
+	if (timeout && !list->sensor->fifoMaxEventCount) {
+		if (flags & SENSORS_BATCH_DRY_RUN)
+			return -EINVAL;
+		timeout = 0;
+	}
+
+	if (flags & SENSORS_BATCH_DRY_RUN)
+		return 0;
+
+	Mutex::Autolock _l(mLock);
+
+	client->delay_ns[list->index] = period_ns;
+	client->latency_ns[list->index] = timeout;
+
+	delay_ns = clientDelay(list, client);
+	setSensorDelay(list, delay_ns ? delay_ns : period_ns);
+
+	list->latency_ns = clientLatency(list, client);
+	publishSnapshot(list);
+	synchronizeSnapshots();
+
+	return 0;
+}
+
+int NativeSensorManager::flush(struct SensorClient *client, int handle)
+{
+	SensorContext *list;
+	Mutex::Autolock _l(mLock);
+
+	list = getInfoByHandle(handle);
+	if (list == NULL) {
+		ALOGE("Invalid handle(%d)", handle);
+		return -EINVAL;
+	}
+
+	if (!clientEnabled(client, list->index))
+		return -EINVAL;
+
+	__atomic_add_fetch(&list->flush_client[client->id], 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&list->flush_pending, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int NativeSensorManager::registerDirectChannel(struct SensorClient *client, int count,
+		int format)
+{
+	SensorDirectChannel *channel;
+	Mutex::Autolock _l(mLock);
+
+	if (client->channel != NULL)
+		return -EBUSY;
+
+	channel = new SensorDirectChannel(count, format);
+	if (channel->initCheck()) {
+		delete channel;
+		return -ENOMEM;
+	}
+
+	client->channel = channel;
+	return channel->getFd();
+}
+
+int NativeSensorManager::configDirectChannel(struct SensorClient *client, int handle,
+		int64_t period_ns)
+{
+	SensorContext *list;
+	int index;
+	int err;
+	Mutex::Autolock _l(mLock);
+
+	list = getInfoByHandle(handle);
+	if (list == NULL) {
+		ALOGE("Invalid handle(%d)", handle);
+		return -EINVAL;
+	}
+
+	if ((client->channel == NULL) && (client->callback == NULL))
+		return -EINVAL;
+
+	index = list->index;
+	if (period_ns) {
+		client->enable_mask[index / 32] |= 1U << (index % 32);
+		client->direct_mask[index / 32] |= 1U << (index % 32);
+		client->delay_ns[index] = period_ns;
+		client->latency_ns[index] = 0;
+	} else {
+		client->enable_mask[index / 32] &= ~(1U << (index % 32));
+		client->direct_mask[index / 32] &= ~(1U << (index % 32));
+	}
+
+	err = applyClients(list);
+	synchronizeSnapshots();
+
+	return err;
+}
+
+int NativeSensorManager::getRawScale(int handle, struct sensors_raw_scale_t *scale)
+{
+	const SensorContext *list = getInfoByHandle(handle);
+
+	if ((list == NULL) || !list->has_raw)
+		return -EINVAL;
+
+	memcpy(scale->scale, list->raw_scale, sizeof(scale->scale));
+	return 0;
+}
+
+/* Deliver the direct reports of client to callback instead of its channel.
+ * It can only change while no sensor is configured for them, so the readers
+ * never see a callback with the cookie of another.
+ */
+int NativeSensorManager::registerCallback(struct SensorClient *client,
+		sensors_event_callback_t callback, void *cookie)
+{
+	int i;
+	Mutex::Autolock _l(mLock);
+
+	for (i = 0; i < mMaskWords; i++) {
+		if (client->direct_mask[i])
+			return -EBUSY;
+	}
+
+	client->callback = callback;
+	client->cookie = cookie;
+
+	return 0;
+}
+
+/* The time at which the batches of the active sensors have to be delivered,
+ * which is the earliest max report latency deadline or now if a FIFO reached
+ * its watermark. Returns -1 if no events are held.
+ */
+int64_t NativeSensorManager::getBatchDeadline()
+{
+	const SensorContext *ctx;
+	const SensorSnapshot *snap;
+	uint32_t bits;
+	int64_t deadline = -1;
+	int64_t t;
+	int phase;
+	int w;
+
+	phase = rcuReadLock();
+	for (w = 0; w < mMaskWords; w++) {
+		bits = __atomic_load_n(&active_mask[w], __ATOMIC_ACQUIRE);
+		for (; bits; bits &= bits - 1) {
+			ctx = &context[w * 32 + __builtin_ctz(bits)];
+			if ((ctx->fifo == NULL) || !ctx->fifo->available())
+				continue;
+			t = __atomic_load_n(&ctx->batch_start_ns, __ATOMIC_ACQUIRE);
+			if (t <= __atomic_load_n(&mBatchRelease, __ATOMIC_ACQUIRE))
+				continue;
+			snap = __atomic_load_n(&ctx->snapshot, __ATOMIC_SEQ_CST);
+			if (ctx->fifo->available() < (int)ctx->sensor->fifoMaxEventCount * mWatermark / 100)
+				t += snap->latency_ns;
+			if ((deadline < 0) || (t < deadline))
+				deadline = t;
+		}
+	}
+	rcuReadUnlock(phase);
+
+	return deadline;
 }
 
 int NativeSensorManager::calibrate(int handle, struct cal_cmd_t *para)
@@ -900,6 +2681,7 @@ int NativeSensorManager::calibrate(int handle, struct cal_cmd_t *para)
 	struct cal_result_t cal_result;
 	sensors_XML& sensor_XML(sensors_XML :: getInstance());
 	int err;
+	Mutex::Autolock _l(mLock);
 
 	list = getInfoByHandle(handle);
 	if(list == NULL) {
@@ -38,9 +38,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <SensorBase.h>
 
 #include <utils/Singleton.h>
+#include <utils/Mutex.h>
 #include <cutils/list.h>
 #include <sensors.h>
-#include <utils/KeyedVector.h>
 
 #include "AccelSensor.h"
 #include "LightSensor.h"
@@ -49,14 +49,42 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "GyroSensor.h"
 #include "PressureSensor.h"
 #include "VirtualSensor.h"
+#include "SensorReader.h"
+#include "SensorDirectChannel.h"
+#include "SensorUring.h"
+#include "SensorWakeLock.h"
+#include "SensorInputIndex.h"
 
 #include "sensors_extension.h"
 #include "sensors_XML.h"
 using namespace android;
 
+#ifndef EVENT_PATH
 #define EVENT_PATH "/dev/input/"
+#endif
 #define DEPEND_ON(m, t) (m & (1ULL << t))
 #define SENSORS_HANDLE(x) (SENSORS_HANDLE_BASE + x + 1)
+#define MASK_WORDS(n) (((n) + 31) / 32)
+#define MAX_DISCOVERY_THREADS 8 // threads probing the class devices
+/* The discovery cache file, unless sensors.discovery.cache names another one
+ * or is set to "none". The HAL runs in system_server, which owns /data/system
+ * and can write there without any init rc entry or sepolicy rule. Before /data
+ * is decrypted the cache just misses.
+ */
+#define DISCOVERY_CACHE "/data/system/sensors_discovery.cache"
+#define DISCOVERY_CACHE_MAGIC 0x534e5343 // "SNSC"
+#define DISCOVERY_CACHE_VERSION 2
+#define MAX_VIRTUAL_SENSORS 8 // the virtual sensors getDataInfo() can add
+#define DEFAULT_FIFO_SIZE 256
+#define SENSOR_MAX_DELAY_US 1000000 // the longest sampling period reported in sensor_t
+#define DEFAULT_FIFO_WATERMARK 75 // percent of the FIFO size
+#define MAX_CLIENTS 8
+#define CLIENT_QUEUE_SIZE 512
+#define REF_MAPS_PER_SENSOR 8
+#define BACKPRESSURE_INTERVAL_NS 1000000000LL
+#define MAX_SENSOR_TYPES 64 // the types are bits of 64 bit masks
+#define FD_TABLE_SIZE 256 // the data fds above it are looked up by a scan
+#define BACKPRESSURE_SLACK 16 // throttle once more than 1/16th of the events are lost
 
 #ifndef list_for_each_safe
 #define list_for_each_safe(node, n, list) \
@@ -71,27 +99,91 @@ enum {
 	TYPE_FLOAT,
 };
 
+/* What to do with the events of a sensor when its consumer falls behind */
+enum {
+	OVERLOAD_DROP_OLDEST = 0, // drop the stalest queued events to make room
+	OVERLOAD_KEEP_LATEST, // keep the newest event only, for on-change sensors
+	OVERLOAD_BLOCK, // stop reading the sensor until there is room
+};
+
+struct SensorContext;
+
+/* Immutable copy of the control state of a sensor read by the poll path.
+ * The control path builds a new one on every change and swaps it in.
+ */
+struct SensorSnapshot {
+	int enable; // indicate if the sensor is enabled
+	int64_t delay_ns; // the poll delay setting of this sensor
+	int64_t latency_ns; // the max report latency of this sensor
+	uint32_t client_mask; // the clients which enabled this sensor
+	uint32_t direct_mask; // the clients of client_mask using their direct channel
+	int64_t client_delay_ns[MAX_CLIENTS]; // the poll delay requested by each client
+	int listener_count; // number of entries in listener
+	struct SensorContext **listener; // virtual sensors fed with the events of this sensor
+	struct SensorSnapshot *next; // retired snapshots waiting for a grace period
+};
+
 struct SensorContext {
 	char   name[SYSFS_MAXLEN]; // name of the sensor
 	char   vendor[SYSFS_MAXLEN]; // vendor of the sensor
-	char   enable_path[PATH_MAX]; // the control path of this sensor
-	char   data_path[PATH_MAX]; // the data path to get sensor events
+	const char *enable_path; // the control path of this sensor, interned
+	const char *data_path; // the data path to get sensor events, interned
 
 	struct sensor_t *sensor; // point to the sensor_t structure in the sensor list
 	SensorBase     *driver; // point to the sensor driver instance
+	SensorReader   *reader; // the reader thread of this sensor, NULL if read by the poll thread
 
+	int index; // the index of this sensor in the sensor list
 	int data_fd; // the file descriptor of the data device node
 	int enable; // indicate if the sensor is enabled
 	bool is_virtual; // indicate if this is a virtual sensor
+	bool wake_up; // the events of this sensor must be delivered with the AP awake
+	int overload; // OVERLOAD_* policy when a queue of this sensor is full
+	mutable uint32_t dropped; // events lost to the overload policy, updated atomically
 	int64_t delay_ns; // the poll delay setting of this sensor
+	int64_t latency_ns; // the max report latency set by batch()
+	int64_t request_ns; // the poll delay the sensor and its listeners need
+	int64_t applied_ns; // the poll delay the driver runs at
+	int64_t throttle_ns; // the poll delay the consumer keeps up with, 0 if not throttled
+	mutable uint32_t produced; // events read from the driver, updated atomically
+	mutable uint32_t stalled; // events the reader thread held back under OVERLOAD_BLOCK
+	uint32_t seen_produced; // produced at the last backpressure check
+	uint32_t seen_lost; // dropped and stalled at the last backpressure check
 	struct listnode dep_list; // the background sensor type needed for this sensor
+	bool has_raw; // the driver scales its raw counts linearly by raw_scale
+	float raw_scale[3]; // turns the raw counts into data[raw_field..raw_field + 2]
+	int raw_field; // first data field of the events holding the uncalibrated readings
 
 	struct listnode listener; // the head of listeners of this sensor
+
+	struct SensorSnapshot *snapshot; // current state for the poll path, swapped atomically
+
+	SensorEventQueue *fifo; // software FIFO for batching, set at init and never changed
+	int64_t batch_start_ns; // when the oldest event in fifo was queued, accessed atomically
+	int32_t fifo_epoch; // bumped on deactivation to drop the batched events
+	int32_t fifo_seen_epoch; // the epoch the events in fifo belong to
+	int32_t flush_pending; // number of flush complete events to report
+	int32_t flush_client[MAX_CLIENTS]; // flush_pending split per requesting client
 };
 
-struct SensorEventMap {
-	char data_name[80];
-	char data_path[PATH_MAX];
+/* One poll context opened on the HAL. Each client enables the sensors with its
+ * own rate, and receives the events read by the other clients in its queue.
+ * The per sensor arrays are sized to the sensors found.
+ */
+struct SensorClient {
+	int id; // the bit of this client in the client masks
+	uint32_t *enable_mask; // the sensors enabled by this client
+	int64_t *delay_ns; // the poll delay requested by this client
+	int64_t *latency_ns; // the max report latency requested by this client
+	int64_t *last_ns; // timestamp of the last event delivered, by the sensor reader only
+	uint32_t *direct_mask; // the sensors reported to channel
+	SensorDirectChannel *channel; // shared memory for the direct reports, or NULL
+	sensors_event_callback_t callback; // called with the direct reports instead of channel
+	void *cookie; // passed to callback
+	SensorEventQueue *queue; // events read by the other clients for this client
+	SensorEventQueue *wake_queue; // same for the wake-up sensors, delivered first
+	int notify_fd; // signaled when events are queued
+	uint32_t dropped; // events dropped because queue was full
 };
 
 struct SysfsMap {
@@ -100,52 +192,248 @@ struct SysfsMap {
 	int type;
 };
 
+/* The attributes of a class device, read by the discovery workers */
+struct SensorProbe {
+	char entry[NAME_MAX + 1]; // name of the class device
+	struct sensor_t sensor;
+	char name[SYSFS_MAXLEN];
+	char vendor[SYSFS_MAXLEN];
+	char data_path[PATH_MAX];
+	bool valid; // all the attributes read and the type supported
+	int event_err; // result of getEventPath()
+};
+
+/* The discovery cache is a SensorCacheHeader followed by count records */
+struct SensorCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t key; // hash of the build fingerprint and the class devices
+	uint32_t count;
+	uint32_t sum; // hash of the records
+};
+
+struct SensorCacheRecord {
+	char name[SYSFS_MAXLEN];
+	char vendor[SYSFS_MAXLEN];
+	int32_t version;
+	int32_t type;
+	float maxRange;
+	float resolution;
+	float power;
+	int32_t minDelay;
+	char enable_path[PATH_MAX];
+	char data_path[PATH_MAX];
+	char input_name[80]; // name of the input device at data_path
+};
+
+struct SensorProbeWork {
+	class NativeSensorManager *sm;
+	struct SensorProbe *probe;
+	int count;
+	int next; // next probe to claim
+	int classfd;
+};
+
 /* To contain the listener list and denpend list */
 struct SensorRefMap {
 	struct listnode list;
 	struct SensorContext *ctx;
 };
 
+/* A string interned by NativeSensorManager::intern() */
+struct SensorString {
+	struct SensorString *next;
+	char *str;
+};
+
 class NativeSensorManager : public Singleton<NativeSensorManager> {
 	friend class Singleton<NativeSensorManager>;
 	NativeSensorManager();
 	~NativeSensorManager();
-	struct sensor_t sensor_list[MAX_SENSORS];
-	struct SensorContext context[MAX_SENSORS];
-	struct SensorEventMap event_list[MAX_SENSORS];
+	/* Sized to the sensors found at discovery, which never changes afterwards */
+	struct sensor_t *sensor_list;
+	struct SensorContext *context;
 	static const struct SysfsMap node_map[];
 	static const struct sensor_t virtualSensorList[];
 
 	int mSensorCount;
-	bool mScanned;
-	int mEventCount;
+	int mCapacity; // number of entries of context and sensor_list
+	int mMaskWords; // number of words of the sensor bitmaps
+	/* Bitmap of the sensor contexts whose driver is running */
+	uint32_t *active_mask;
+	/* The paths of the sensors, kept for the life of the manager */
+	struct SensorString *mStrings;
+
+	/* Serialize the control path. The poll path never takes it. */
+	Mutex mLock;
+	/* Serialize the poll path of the clients, so every event is read once.
+	 * It has to cover all the sensors, not one: whoever reads any sensor
+	 * is the producer of the queues of every other client, which are
+	 * single producer rings, and a driver may serve several handles from
+	 * one input reader. It also keeps mClients and the ring alive. It is
+	 * never held while waiting for events, only while copying them.
+	 */
+	Mutex mReadLock;
+	struct SensorClient *mClients[MAX_CLIENTS];
+	/* Reads the event devices of the sensors without a reader thread, or NULL */
+	SensorUring *mUring;
+	/* Preallocated listener and dependency nodes, so activate() never allocates */
+	struct SensorRefMap *mRefPool;
+	struct listnode mRefFree;
+	/* Snapshots past their grace period, reused by publishSnapshot() */
+	struct SensorSnapshot *mSnapshotFree;
+	/* Run the hardware sensors at harmonics of the fastest one */
+	bool mHarmonic;
+	/* Slow down the hardware sensors the consumers cannot keep up with */
+	bool mBackpressure;
+	int64_t mBackpressureTime; // when the rates were last checked
+	/* Held while wake-up events are not returned by poll() */
+	SensorWakeLock *mWakeLock;
+	Mutex mWakeLockLock;
+	bool mWakeLockHeld;
+	uint32_t mWakeSeq; // bumped every time the wakelock is asked for
+	/* Readers of the snapshots per grace period phase */
+	int32_t mRcuPhase;
+	int32_t mRcuReaders[2];
+	struct SensorSnapshot *mRetired;
+	/* All the batches queued before this time are delivered. Only moves forward,
+	 * accessed atomically. */
+	int64_t mBatchRelease;
+	int mWatermark;
 
-	DefaultKeyedVector<int32_t, struct SensorContext*> type_map;
-	DefaultKeyedVector<int32_t, struct SensorContext*> handle_map;
-	DefaultKeyedVector<int, struct SensorContext*> fd_map;
+	/* Direct-indexed lookup tables, NULL where there is no sensor */
+	struct SensorContext **handle_table; // mCapacity entries
+	struct SensorContext *type_table[MAX_SENSOR_TYPES];
+	struct SensorContext *fd_table[FD_TABLE_SIZE];
 
-	int getNode(char *buf, char *path, const struct SysfsMap *map);
+	static int getNode(char *buf, int dirfd, const char *node, const struct SysfsMap *map);
+	int allocRegistry(int capacity);
+	const char* intern(const char *str);
+	struct SensorSnapshot* allocSnapshot();
+	static void freeSnapshot(struct SensorSnapshot *snap);
+	void addLookup(struct SensorContext *ctx);
+	SensorContext* findByFd(int fd);
 	int getSensorListInner();
+	void probeSensor(int classfd, struct SensorProbe *probe);
+	static void* probeThread(void *arg);
+	int loadCache(const char *file, uint32_t key);
+	void saveCache(const char *file, uint32_t key, int number);
 	int getDataInfo();
+	struct SensorRefMap* allocRef(struct SensorContext *ctx);
+	void freeRef(struct SensorRefMap *item);
 	int registerListener(struct SensorContext *hw, struct SensorContext *virt);
 	int unregisterListener(struct SensorContext *hw, struct SensorContext *virt);
 	int syncDelay(int handle);
+	int planRates();
+	int applyRate(struct SensorContext *list);
+	int64_t slowestDelay(const struct SensorContext *list);
+	int activateSensor(struct SensorContext *list, int enable);
+	int setSensorDelay(struct SensorContext *list, int64_t ns);
+	int applyClients(struct SensorContext *list);
+	int64_t clientDelay(const struct SensorContext *list, const struct SensorClient *self);
+	int64_t clientLatency(const struct SensorContext *list, const struct SensorClient *self);
+	/* Enabled by a client, or feeding an enabled virtual sensor */
+	static bool hasConsumers(const struct SensorContext *ctx) {
+		return ctx->enable || !list_empty(&ctx->listener);
+	};
+	static bool clientEnabled(const struct SensorClient *client, int index) {
+		return client->enable_mask[index / 32] & (1U << (index % 32));
+	};
+	void notifyClient(struct SensorClient *client);
+	bool clientAccept(struct SensorClient *client, int index, int64_t delay_ns,
+			const sensors_event_t *event);
+	void writeDirect(const struct SensorContext *list, const struct SensorSnapshot *snap,
+			const sensors_event_t *data, int count);
+	void writeCallback(struct SensorClient *client, const struct SensorContext *list,
+			const struct SensorSnapshot *snap, const sensors_event_t *data, int count);
+	void writeRaw(struct SensorClient *client, const struct SensorContext *list,
+			int64_t delay_ns, const sensors_event_t *data, int count);
+	int dispatch(struct SensorClient *self, const struct SensorContext *list,
+			const struct SensorSnapshot *snap, sensors_event_t *data, int count);
+	void initFifo(struct SensorContext *ctx);
+	void initUring();
+	void initFlags(struct SensorContext *ctx);
+	void initOverload(struct SensorContext *ctx);
+	int readDriver(const struct SensorContext *list, const struct SensorSnapshot *snap,
+			sensors_event_t *data, int count);
+	int readBatch(struct SensorContext *list, const struct SensorSnapshot *snap,
+			sensors_event_t *data, int count);
+	int reportFlush(struct SensorClient *self, struct SensorContext *list,
+			sensors_event_t *data, int count);
+	bool batchExpired(const struct SensorContext *list, const struct SensorSnapshot *snap,
+			int64_t now);
+	void updateActiveMask(const struct SensorContext *ctx);
+	void publishSnapshot(struct SensorContext *ctx);
+	void synchronizeSnapshots();
+	int rcuReadLock();
+	void rcuReadUnlock(int phase);
 	int initVirtualSensor(struct SensorContext *ctx, int handle, int64_t dep, struct sensor_t info);
 	int initCalibrate(const SensorContext *list);
-	int getEventPath(const char *sysfs_path, char *event_path);
+	int getEventPath(int dirfd, const char *devname, char *event_path);
 	int getEventPathOld(const struct SensorContext *list, char *event_path);
 public:
 	int getSensorList(const sensor_t **list);
-	inline SensorContext* getInfoByFd(int fd) { return fd_map.valueFor(fd); };
-	inline SensorContext* getInfoByHandle(int handle) { return handle_map.valueFor(handle); };
-	inline SensorContext* getInfoByType(int type) { return type_map.valueFor(type); };
+	inline SensorContext* getInfoByFd(int fd) {
+		return ((unsigned int)fd < FD_TABLE_SIZE) ? fd_table[fd] : findByFd(fd);
+	};
+	inline SensorContext* getInfoByHandle(int handle) {
+		unsigned int i = handle - SENSORS_HANDLE(0);
+		return (i < (unsigned int)mCapacity) ? handle_table[i] : NULL;
+	};
+	inline SensorContext* getInfoByType(int type) {
+		return ((unsigned int)type < MAX_SENSOR_TYPES) ? type_table[type] : NULL;
+	};
+	inline SensorContext* getInfoByIndex(int index) { return &context[index]; };
+	void getActiveMask(uint32_t *mask);
+	int64_t getDelay(const struct SensorContext *ctx);
 	int getSensorCount() {return mSensorCount;}
+	int getMaskWords() const { return mMaskWords; }
 	void dump();
 	int hasPendingEvents(int handle);
-	int activate(int handle, int enable);
-	int setDelay(int handle, int64_t ns);
-	int readEvents(int handle, sensors_event_t *data, int count);
+	struct SensorClient* registerClient();
+	void unregisterClient(struct SensorClient *client);
+	int activate(struct SensorClient *client, int handle, int enable);
+	int setDelay(struct SensorClient *client, int handle, int64_t ns);
+	int readEvents(struct SensorClient *client, int handle, sensors_event_t *data, int count);
+	int readClientEvents(struct SensorClient *client, sensors_event_t *data, int count);
+	bool hasClientEvents(const struct SensorClient *client) {
+		return client->wake_queue->available() || client->queue->available();
+	};
 	int calibrate(int handle, struct cal_cmd_t *para);
+	int batch(struct SensorClient *client, int handle, int flags, int64_t period_ns,
+			int64_t timeout);
+	int flush(struct SensorClient *client, int handle);
+	int registerDirectChannel(struct SensorClient *client, int count, int format);
+	int getRawScale(int handle, struct sensors_raw_scale_t *scale);
+	int configDirectChannel(struct SensorClient *client, int handle, int64_t period_ns);
+	int registerCallback(struct SensorClient *client, sensors_event_callback_t callback,
+			void *cookie);
+	int getUringFd() const { return mUring != NULL ? mUring->getFd() : -1; };
+	bool readsWithUring(const struct SensorContext *ctx) const {
+		return (mUring != NULL) && (ctx->data_fd >= 0) && mUring->hasFd(ctx->data_fd);
+	};
+	int harvestReads(struct SensorContext **ready, int count);
+	bool getUringStats(uint32_t *syscalls, uint32_t *reads) {
+		if (mUring == NULL)
+			return false;
+		mUring->getStats(syscalls, reads);
+		return true;
+	};
+	void submitReads();
+	void setWakeLock(SensorWakeLock *wakelock);
+	void holdWakeLock();
+	bool isWakeLockHeld() const { return __atomic_load_n(&mWakeLockHeld, __ATOMIC_ACQUIRE); };
+	uint32_t getWakeSequence() const { return __atomic_load_n(&mWakeSeq, __ATOMIC_ACQUIRE); };
+	void releaseWakeLock(uint32_t seq);
+	bool hasWakeEvents();
+	static void countDropped(const struct SensorContext *ctx, int count);
+	uint32_t getDropCount(const struct SensorContext *ctx) const {
+		return __atomic_load_n(&ctx->dropped, __ATOMIC_RELAXED);
+	};
+	bool reportDirect(const struct SensorContext *list, const sensors_event_t *data, int count);
+	int64_t getBatchDeadline();
+	void releaseBatches(int64_t now);
+	void adaptRates(int64_t now);
 };
 
 #endif
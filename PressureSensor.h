@@ -48,6 +48,7 @@ public:
 	virtual ~PressureSensor();
 	virtual int readEvents(sensors_event_t* data, int count);
 	virtual bool hasPendingEvents() const;
+	virtual int getRawScale(float *scale, int *field) const;
 	virtual int setDelay(int32_t handle, int64_t ns);
 	virtual int enable(int32_t handle, int enabled);
 };
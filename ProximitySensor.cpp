@@ -205,7 +205,7 @@ int ProximitySensor::readEvents(sensors_event_t* data, int count)
         return mEnabled ? 1 : 0;
     }
 
-    ssize_t n = mInputReader.fill(data_fd);
+    ssize_t n = mInputReader.fill(data_fd, mUring, mUringSlot);
     if (n < 0)
         return n;
 
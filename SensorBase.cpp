@@ -30,6 +30,7 @@
 
 #include "NativeSensorManager.h"
 #include "SensorBase.h"
+#include "SensorInputIndex.h"
 
 /*****************************************************************************/
 
@@ -38,7 +39,7 @@ SensorBase::SensorBase(
         const char* data_name,
         const struct SensorContext* context /* = NULL */)
     : dev_name(dev_name), data_name(data_name),
-      algo(NULL), dev_fd(-1), data_fd(-1)
+      algo(NULL), dev_fd(-1), data_fd(-1), mUring(NULL), mUringSlot(-1)
 {
         if (context != NULL) {
                 CalibrationManager& cm(CalibrationManager::getInstance());
@@ -99,39 +100,14 @@ int64_t SensorBase::getTimestamp() {
 
 int SensorBase::openInput(const char* inputName) {
     int fd = -1;
-    const char *dirname = "/dev/input";
     char devname[PATH_MAX];
-    char *filename;
-    DIR *dir;
-    struct dirent *de;
-    dir = opendir(dirname);
-    if(dir == NULL)
-        return -1;
-    strcpy(devname, dirname);
-    filename = devname + strlen(devname);
-    *filename++ = '/';
-    while((de = readdir(dir))) {
-        if(de->d_name[0] == '.' &&
-                (de->d_name[1] == '\0' ||
-                        (de->d_name[1] == '.' && de->d_name[2] == '\0')))
-            continue;
-        strcpy(filename, de->d_name);
+
+    /* Only the matching device is opened */
+    if (SensorInputIndex::lookup(inputName, devname, sizeof(devname)) == 0) {
         fd = open(devname, O_RDONLY);
-        if (fd>=0) {
-            char name[80];
-            if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
-                name[0] = '\0';
-            }
-            if (!strcmp(name, inputName)) {
-                strcpy(input_name, filename);
-                break;
-            } else {
-                close(fd);
-                fd = -1;
-            }
-        }
+        if (fd >= 0)
+            strlcpy(input_name, strrchr(devname, '/') + 1, sizeof(input_name));
     }
-    closedir(dir);
     ALOGE_IF(fd<0, "couldn't find '%s' input device", inputName);
     return fd;
 }
@@ -141,6 +117,15 @@ int SensorBase::injectEvents(sensors_event_t*, int)
 	return 0;
 }
 
+/* Fill the factors turning the raw counts of the driver into data[field..
+ * field + 2] of its events, if it scales them linearly. field is where the
+ * readings are before any calibration.
+ */
+int SensorBase::getRawScale(float *, int *) const
+{
+	return -EINVAL;
+}
+
 int SensorBase::calibrate(int32_t handle, struct cal_cmd_t *para,
                  struct cal_result_t *outpara)
 {
@@ -32,6 +32,7 @@
 
 struct sensors_event_t;
 struct SensorContext;
+class SensorUring;
 
 class SensorBase {
 protected:
@@ -43,9 +44,10 @@ protected:
 	int		data_fd;
 	int64_t report_time;
 	bool mUseAbsTimeStamp;
+	SensorUring *mUring; // reads data_fd if set, through mUringSlot
+	int mUringSlot;
 
 	int openInput(const char* inputName);
-	static int64_t getTimestamp();
 
 
 	static int64_t timevalToNano(timeval const& t) {
@@ -61,10 +63,14 @@ public:
 
 	virtual ~SensorBase();
 
+	static int64_t getTimestamp();
+
 	virtual int readEvents(sensors_event_t* data, int count) = 0;
 	virtual int injectEvents(sensors_event_t* data, int count);
 	virtual bool hasPendingEvents() const;
+	virtual int getRawScale(float *scale, int *field) const;
 	virtual int getFd() const;
+	void setUring(SensorUring *uring, int slot) { mUring = uring; mUringSlot = slot; }
 	virtual int setDelay(int32_t handle, int64_t ns);
 	virtual int enable(int32_t handle, int enabled) = 0;
 	virtual int calibrate(int32_t handle, struct cal_cmd_t *para,
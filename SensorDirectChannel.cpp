@@ -0,0 +1,144 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <cutils/log.h>
+
+#include "SensorDirectChannel.h"
+#include "SensorThread.h"
+
+/*****************************************************************************/
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC		0x0001U
+#define MFD_ALLOW_SEALING	0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS		1033
+#define F_SEAL_SEAL		0x0001
+#define F_SEAL_SHRINK		0x0002
+#define F_SEAL_GROW		0x0004
+#endif
+
+static int memfd_open(const char *name)
+{
+#ifdef __NR_memfd_create
+	return syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Round up to the next power of two so that the indexes can be masked */
+static uint32_t channel_size(int count)
+{
+	uint32_t size = DIRECT_CHANNEL_MIN_SIZE;
+
+	while ((size < (uint32_t)count) && (size < DIRECT_CHANNEL_MAX_SIZE))
+		size <<= 1;
+
+	return size;
+}
+
+SensorDirectChannel::SensorDirectChannel(int count, int format)
+	: mFd(-1),
+	  mSize(0),
+	  mHeader(NULL),
+	  mRing(NULL),
+	  mRecordSize(format == SENSORS_DIRECT_FORMAT_RAW ?
+			sizeof(sensors_raw_frame_t) : sizeof(sensors_event_t)),
+	  mMask(channel_size(count) - 1)
+{
+	/* Keep the events cache line aligned */
+	uint32_t offset = (sizeof(*mHeader) + 63) & ~63;
+	void *mem;
+
+	mFd = memfd_open("sensors-direct");
+	if (mFd < 0) {
+		ALOGE("create direct channel failed.(%s)\n", strerror(errno));
+		return;
+	}
+
+	mSize = offset + (mMask + 1) * mRecordSize;
+	if (ftruncate(mFd, mSize)) {
+		ALOGE("resize direct channel failed.(%s)\n", strerror(errno));
+		return;
+	}
+
+	/* The consumer must not be able to resize the memory under us */
+	if (fcntl(mFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL))
+		ALOGW("seal direct channel failed.(%s)\n", strerror(errno));
+
+	mem = mmap(NULL, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+	if (mem == MAP_FAILED) {
+		ALOGE("map direct channel failed.(%s)\n", strerror(errno));
+		return;
+	}
+
+	SensorThread::lockBuffer(mem, mSize);
+
+	mHeader = (struct sensors_direct_header_t *)mem;
+	mRing = (char *)mem + offset;
+	mHeader->version = SENSORS_DIRECT_CHANNEL_VERSION;
+	mHeader->capacity = mMask + 1;
+	mHeader->event_offset = offset;
+	mHeader->format = format;
+	mHeader->write_count = 0;
+}
+
+SensorDirectChannel::~SensorDirectChannel()
+{
+	if (mHeader != NULL)
+		munmap(mHeader, mSize);
+	if (mFd >= 0)
+		close(mFd);
+}
+
+/* Overwrite the oldest events if the consumer is late, it can tell from
+ * write_count how many it lost.
+ */
+void SensorDirectChannel::write(const void* data, int count)
+{
+	android::Mutex::Autolock _l(mLock);
+	uint64_t n = mHeader->write_count;
+	int i;
+
+	for (i = 0; i < count; i++, n++) {
+		/* The consumer must see write_count move before the slot is reused */
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(mRing + (n & mMask) * mRecordSize,
+				(const char *)data + i * mRecordSize, mRecordSize);
+		__atomic_store_n(&mHeader->write_count, n + 1, __ATOMIC_RELEASE);
+	}
+}
@@ -0,0 +1,75 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_SENSOR_DIRECT_CHANNEL_H
+#define ANDROID_SENSOR_DIRECT_CHANNEL_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <utils/Mutex.h>
+
+#include "sensors_extension.h"
+
+/*****************************************************************************/
+
+#define DIRECT_CHANNEL_MIN_SIZE	64
+#define DIRECT_CHANNEL_MAX_SIZE	65536
+
+/* A ring of sensor events in a memfd shared with the consumer, laid out as
+ * described by sensors_direct_header_t. The consumer maps getFd() and reads
+ * the events without any syscall. Several HAL threads may write, the consumer
+ * never takes any lock.
+ */
+class SensorDirectChannel
+{
+	int mFd;
+	size_t mSize;
+	struct sensors_direct_header_t *mHeader;
+	char *mRing;
+	size_t mRecordSize; // size of an event in the ring, depends on the format
+	uint32_t mMask;
+	android::Mutex mLock; // serialize the writers
+
+	void write(const void* data, int count);
+
+public:
+	SensorDirectChannel(int count, int format = SENSORS_DIRECT_FORMAT_EVENT);
+	~SensorDirectChannel();
+	int initCheck() const { return mHeader != NULL ? 0 : -ENOMEM; }
+	int getFd() const { return mFd; }
+	bool isRaw() const { return mHeader->format == SENSORS_DIRECT_FORMAT_RAW; }
+	void write(const sensors_event_t* data, int count) { write((const void *)data, count); }
+	void write(const sensors_raw_frame_t* data, int count) { write((const void *)data, count); }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_DIRECT_CHANNEL_H
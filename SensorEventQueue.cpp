@@ -0,0 +1,175 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "SensorEventQueue.h"
+#include "SensorThread.h"
+
+/*****************************************************************************/
+
+/* Round up to the next power of two so that the indexes can be masked */
+static uint32_t queue_size(size_t numEvents)
+{
+	uint32_t size = 1;
+
+	while (size < numEvents)
+		size <<= 1;
+
+	return size;
+}
+
+SensorEventQueue::SensorEventQueue(size_t numEvents)
+	: mBuffer(new sensors_event_t[queue_size(numEvents)]),
+	  mMask(queue_size(numEvents) - 1),
+	  mHead(0),
+	  mTail(0)
+{
+	SensorThread::lockBuffer(mBuffer, (mMask + 1) * sizeof(mBuffer[0]));
+}
+
+SensorEventQueue::~SensorEventQueue()
+{
+	delete [] mBuffer;
+}
+
+int SensorEventQueue::write(const sensors_event_t* data, int count)
+{
+	uint32_t head = mHead;
+	uint32_t tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+	int space = (mMask + 1) - (head - tail);
+	int i;
+
+	if (count > space)
+		count = space;
+
+	for (i = 0; i < count; i++)
+		mBuffer[(head + i) & mMask] = data[i];
+
+	/* Publish the events after they are written */
+	__atomic_store_n(&mHead, head + count, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+int SensorEventQueue::read(sensors_event_t* data, int count)
+{
+	uint32_t tail, head;
+	int avail, n, i;
+
+	do {
+		tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+		avail = head - tail;
+		n = count > avail ? avail : count;
+
+		for (i = 0; i < n; i++)
+			data[i] = mBuffer[(tail + i) & mMask];
+
+		/* Release the slots after they are copied out. If the producer
+		 * dropped some of them meanwhile the copy may be torn, start over.
+		 */
+	} while (!__atomic_compare_exchange_n(&mTail, &tail, tail + n, false,
+				__ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE));
+
+	return n;
+}
+
+/* Drop up to count of the oldest events, called by the producer only.
+ * Returns the number of events dropped.
+ */
+int SensorEventQueue::discard(int count)
+{
+	uint32_t tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+	int n;
+
+	do {
+		n = mHead - tail;
+		if (count < n)
+			n = count;
+	} while (!__atomic_compare_exchange_n(&mTail, &tail, tail + n, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return n;
+}
+
+/* Write all the events, dropping the oldest ones to make room. Called by the
+ * producer only. Returns the number of events dropped.
+ */
+int SensorEventQueue::overwrite(const sensors_event_t* data, int count)
+{
+	int size = mMask + 1;
+	int dropped = 0;
+	int space;
+
+	if (count > size) {
+		dropped = count - size;
+		data += dropped;
+		count = size;
+	}
+
+	space = size - available();
+	if (count > space)
+		dropped += discard(count - space);
+
+	write(data, count);
+
+	return dropped;
+}
+
+int SensorEventQueue::available() const
+{
+	/* The tail first, the head never moves back behind it */
+	uint32_t tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&mHead, __ATOMIC_ACQUIRE) - tail;
+}
+
+/* Drop all the events, called by the consumer only */
+void SensorEventQueue::clear()
+{
+	uint32_t tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+
+	while (!__atomic_compare_exchange_n(&mTail, &tail,
+				__atomic_load_n(&mHead, __ATOMIC_ACQUIRE), false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		;
+}
+
+/* The oldest event, or NULL if the queue is empty. Called by the consumer
+ * only, on a queue the producer does not drop events from.
+ */
+const sensors_event_t* SensorEventQueue::peek() const
+{
+	uint32_t tail = mTail;
+
+	if (__atomic_load_n(&mHead, __ATOMIC_ACQUIRE) == tail)
+		return NULL;
+
+	return &mBuffer[tail & mMask];
+}
@@ -0,0 +1,68 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_SENSOR_EVENT_QUEUE_H
+#define ANDROID_SENSOR_EVENT_QUEUE_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+
+/*****************************************************************************/
+
+/* Lock-free single producer single consumer ring of sensor events.
+ * Only one thread may call write() and only one thread may call read().
+ * The producer may also drop the oldest events with discard() or
+ * overwrite(), so the consumer retries a read racing with it.
+ */
+class SensorEventQueue
+{
+	sensors_event_t* const mBuffer;
+	const uint32_t mMask;
+	uint32_t mHead; // only modified by the producer
+	uint32_t mTail; // advanced by the consumer, or by the producer dropping events
+
+public:
+	SensorEventQueue(size_t numEvents);
+	~SensorEventQueue();
+	int write(const sensors_event_t* data, int count);
+	int read(sensors_event_t* data, int count);
+	int discard(int count);
+	int overwrite(const sensors_event_t* data, int count);
+	int available() const;
+	void clear();
+	const sensors_event_t* peek() const;
+	int capacity() const { return mMask + 1; }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_EVENT_QUEUE_H
@@ -0,0 +1,168 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/log.h>
+
+#include "SensorInputIndex.h"
+
+/*****************************************************************************/
+
+#ifndef INPUT_CLASS_PATH
+#define INPUT_CLASS_PATH	"/sys/class/input/"
+#endif
+#ifndef INPUT_DEV_PATH
+#define INPUT_DEV_PATH		"/dev/input/"
+#endif
+
+struct SensorInputEntry *SensorInputIndex::mEntries = NULL;
+int SensorInputIndex::mCount = 0;
+bool SensorInputIndex::mBuilt = false;
+pthread_mutex_t SensorInputIndex::mLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Read the device name of each eventN of the input class. Called with mLock
+ * held.
+ */
+void SensorInputIndex::build()
+{
+	DIR *dir;
+	struct dirent *de;
+	struct SensorInputEntry *entry;
+	char node[PATH_MAX];
+	ssize_t len;
+	int entries = 0;
+	int fd;
+
+	mBuilt = true;
+
+	dir = opendir(INPUT_CLASS_PATH);
+	if (dir == NULL) {
+		ALOGE("open %s failed.(%s)\n", INPUT_CLASS_PATH, strerror(errno));
+		return;
+	}
+
+	while ((de = readdir(dir))) {
+		if (strncmp(de->d_name, "event", strlen("event")) == 0)
+			entries++;
+	}
+
+	mEntries = new SensorInputEntry[entries];
+	rewinddir(dir);
+
+	while ((de = readdir(dir)) && (mCount < entries)) {
+		if (strncmp(de->d_name, "event", strlen("event")) != 0)
+			continue;
+
+		snprintf(node, sizeof(node), "%s/device/name", de->d_name);
+		fd = openat(dirfd(dir), node, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		entry = &mEntries[mCount];
+		len = read(fd, entry->name, sizeof(entry->name) - 1);
+		close(fd);
+		if (len <= 0)
+			continue;
+
+		entry->name[len] = '\0';
+		if (entry->name[len - 1] == '\n')
+			entry->name[len - 1] = '\0';
+		strlcpy(entry->event, de->d_name, sizeof(entry->event));
+		mCount++;
+	}
+
+	closedir(dir);
+}
+
+int SensorInputIndex::lookup(const char *name, char *path, size_t len)
+{
+	int err = -ENOENT;
+	int i;
+
+	pthread_mutex_lock(&mLock);
+
+	if (!mBuilt)
+		build();
+
+	for (i = 0; i < mCount; i++) {
+		if (strcmp(mEntries[i].name, name) == 0) {
+			snprintf(path, len, "%s%s", INPUT_DEV_PATH, mEntries[i].event);
+			err = 0;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&mLock);
+
+	return err;
+}
+
+int SensorInputIndex::getName(const char *path, char *name, size_t len)
+{
+	int err = -ENOENT;
+	int i;
+
+	name[0] = '\0';
+	if (strncmp(path, INPUT_DEV_PATH, strlen(INPUT_DEV_PATH)) != 0)
+		return err;
+	path += strlen(INPUT_DEV_PATH);
+
+	pthread_mutex_lock(&mLock);
+
+	if (!mBuilt)
+		build();
+
+	for (i = 0; i < mCount; i++) {
+		if (strcmp(mEntries[i].event, path) == 0) {
+			strlcpy(name, mEntries[i].name, len);
+			err = 0;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&mLock);
+
+	return err;
+}
+
+void SensorInputIndex::release()
+{
+	pthread_mutex_lock(&mLock);
+
+	delete [] mEntries;
+	mEntries = NULL;
+	mCount = 0;
+	mBuilt = false;
+
+	pthread_mutex_unlock(&mLock);
+}
@@ -0,0 +1,75 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_SENSOR_INPUT_INDEX_H
+#define ANDROID_SENSOR_INPUT_INDEX_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+struct SensorInputEntry {
+	char name[80]; // name of the input device
+	char event[16]; // its event node under /dev/input
+};
+
+/* Maps the names of the input devices to their event nodes. It is read from
+ * /sys/class/input, as opening the input devices is slow and wakes up some
+ * drivers. Built on the first lookup and shared by the discovery and the
+ * drivers looking up their input device by name.
+ */
+class SensorInputIndex {
+	static struct SensorInputEntry *mEntries;
+	static int mCount;
+	static bool mBuilt;
+	static pthread_mutex_t mLock;
+
+	static void build();
+
+public:
+	/* Copy the path of the event node of the input device named name to
+	 * path. Return 0, or -ENOENT leaving path alone.
+	 */
+	static int lookup(const char *name, char *path, size_t len);
+
+	/* Copy the name of the input device of the event node at path to name.
+	 * Return 0, or -ENOENT leaving name empty.
+	 */
+	static int getName(const char *path, char *name, size_t len);
+
+	/* Drop the index, the next lookup reads /sys/class/input again */
+	static void release();
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_INPUT_INDEX_H
@@ -0,0 +1,264 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <cutils/log.h>
+
+#include "NativeSensorManager.h"
+#include "SensorReader.h"
+#include "SensorThread.h"
+
+/*****************************************************************************/
+
+SensorReader::SensorReader(const struct SensorContext *context)
+	: mContext(context),
+	  mQueue(READER_QUEUE_SIZE),
+	  mStarted(false),
+	  mExit(false),
+	  mBlocked(false)
+{
+	mNotifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ALOGE_IF(mNotifyFd<0, "error creating notify eventfd (%s)", strerror(errno));
+	mControlFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ALOGE_IF(mControlFd<0, "error creating control eventfd (%s)", strerror(errno));
+}
+
+SensorReader::~SensorReader()
+{
+	stop();
+	close(mNotifyFd);
+	close(mControlFd);
+}
+
+int SensorReader::start()
+{
+	int err;
+
+	if (mStarted)
+		return 0;
+
+	if ((mNotifyFd < 0) || (mControlFd < 0))
+		return -EINVAL;
+
+	err = pthread_create(&mThread, NULL, threadLoop, this);
+	if (err) {
+		ALOGE("create reader thread for %s failed.(%s)\n",
+				mContext->sensor->name, strerror(err));
+		return -err;
+	}
+
+	mStarted = true;
+	return 0;
+}
+
+void SensorReader::stop()
+{
+	if (!mStarted)
+		return;
+
+	__atomic_store_n(&mExit, true, __ATOMIC_RELEASE);
+	kick();
+	pthread_join(mThread, NULL);
+	mStarted = false;
+}
+
+/* Wake up the reader thread so that it checks the driver for pending events */
+void SensorReader::kick()
+{
+	const uint64_t msg = 1;
+	int result = write(mControlFd, &msg, sizeof(msg));
+	ALOGE_IF(result<0, "error kicking reader thread (%s)", strerror(errno));
+}
+
+void SensorReader::notify()
+{
+	const uint64_t msg = 1;
+	int result = write(mNotifyFd, &msg, sizeof(msg));
+	ALOGE_IF(result<0, "error notifying reader consumer (%s)", strerror(errno));
+}
+
+void* SensorReader::threadLoop(void *arg)
+{
+	SensorReader *reader = (SensorReader *)arg;
+	char name[16];
+
+	snprintf(name, sizeof(name), "sensors-%s", reader->mContext->sensor->name);
+	pthread_setname_np(pthread_self(), name);
+	SensorThread::applyPolicy("reader");
+
+	reader->loop();
+	return NULL;
+}
+
+void SensorReader::loop()
+{
+	SensorBase *driver = mContext->driver;
+	sensors_event_t buf[READER_BATCH_SIZE];
+	struct pollfd fds[2];
+	uint64_t msg;
+	int nb, n;
+
+	fds[0].fd = mContext->data_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = mControlFd;
+	fds[1].events = POLLIN;
+
+	while (!__atomic_load_n(&mExit, __ATOMIC_ACQUIRE)) {
+		if (!driver->hasPendingEvents()) {
+			fds[0].revents = fds[1].revents = 0;
+			n = poll(fds, 2, -1);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				ALOGE("poll() failed (%s)", strerror(errno));
+				break;
+			}
+
+			if (fds[1].revents & POLLIN)
+				read(mControlFd, &msg, sizeof(msg));
+
+			if (!(fds[0].revents & POLLIN))
+				continue;
+		}
+
+		do {
+			nb = driver->readEvents(buf, ARRAY_SIZE(buf));
+		} while (nb == -EINTR);
+
+		if (nb <= 0) {
+			ALOGE_IF((nb < 0) && (nb != -EAGAIN), "readEvents failed for %s.(%d)",
+					mContext->sensor->name, nb);
+			continue;
+		}
+
+		/* Until the poll thread returns them */
+		if (mContext->wake_up)
+			NativeSensorManager::getInstance().holdWakeLock();
+
+		/* The direct channels get the events right away */
+		if (!NativeSensorManager::getInstance().reportDirect(mContext, buf, nb))
+			continue;
+
+		__atomic_fetch_add(&mContext->produced, nb, __ATOMIC_RELAXED);
+		queue(buf, nb);
+	}
+}
+
+/* Queue the events following the overload policy of the sensor */
+void SensorReader::queue(const sensors_event_t* data, int count)
+{
+	int space = mQueue.capacity() - mQueue.available();
+	int n;
+
+	switch (mContext->overload) {
+		case OVERLOAD_KEEP_LATEST:
+			if (count > space) {
+				n = mQueue.discard(mQueue.capacity());
+				NativeSensorManager::countDropped(mContext, n + count - 1);
+				data += count - 1;
+				count = 1;
+			}
+			mQueue.write(data, count);
+			break;
+		case OVERLOAD_BLOCK:
+			/* Leave the rest in the driver until the consumer catches up */
+			n = mQueue.write(data, count);
+			if (n < count)
+				__atomic_fetch_add(&mContext->stalled, count - n, __ATOMIC_RELAXED);
+			while (n < count) {
+				notify();
+				if (!waitRoom())
+					return;
+				n += mQueue.write(data + n, count - n);
+			}
+			break;
+		default:
+			n = mQueue.overwrite(data, count);
+			if (n)
+				NativeSensorManager::countDropped(mContext, n);
+			break;
+	}
+
+	notify();
+}
+
+/* Wait until the consumer reads some events. Returns false on stop */
+bool SensorReader::waitRoom()
+{
+	struct pollfd fds;
+	uint64_t msg;
+
+	fds.fd = mControlFd;
+	fds.events = POLLIN;
+
+	/* Let the consumer know, then check again for the room it made meanwhile */
+	__atomic_store_n(&mBlocked, true, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (mQueue.available() == mQueue.capacity()) {
+		if (__atomic_load_n(&mExit, __ATOMIC_ACQUIRE))
+			break;
+		if ((poll(&fds, 1, -1) < 0) && (errno != EINTR)) {
+			ALOGE("poll() failed (%s)", strerror(errno));
+			break;
+		}
+		read(mControlFd, &msg, sizeof(msg));
+	}
+	__atomic_store_n(&mBlocked, false, __ATOMIC_RELEASE);
+
+	return (mQueue.available() < mQueue.capacity()) &&
+		!__atomic_load_n(&mExit, __ATOMIC_ACQUIRE);
+}
+
+/* Called by the poll thread only */
+int SensorReader::readEvents(sensors_event_t* data, int count)
+{
+	uint64_t msg;
+	int nb;
+
+	read(mNotifyFd, &msg, sizeof(msg));
+	nb = mQueue.read(data, count);
+
+	/* Keep the notify fd readable while there are events left */
+	if (mQueue.available())
+		notify();
+
+	/* The reader waits for this room under the block policy */
+	if (nb && __atomic_load_n(&mBlocked, __ATOMIC_SEQ_CST))
+		kick();
+
+	return nb;
+}
+
+bool SensorReader::hasPendingEvents() const
+{
+	return mQueue.available() != 0;
+}
@@ -0,0 +1,80 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_SENSOR_READER_H
+#define ANDROID_SENSOR_READER_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "SensorEventQueue.h"
+
+/*****************************************************************************/
+
+#define READER_QUEUE_SIZE	256
+#define READER_BATCH_SIZE	16
+
+struct SensorContext;
+
+/* A dedicated thread decoding the events of one hardware sensor into a
+ * SensorEventQueue. The poll thread waits on getFd() and drains the queue
+ * with readEvents(), so it never blocks on the driver.
+ */
+class SensorReader {
+	const struct SensorContext *mContext;
+	SensorEventQueue mQueue;
+	pthread_t mThread;
+	bool mStarted;
+	bool mExit;
+	int mNotifyFd; // signaled to the consumer when events are queued
+	int mControlFd; // signaled to the reader thread on kick or stop
+	bool mBlocked; // the reader waits for the consumer to make room
+
+	static void* threadLoop(void *arg);
+	void loop();
+	void notify();
+	void queue(const sensors_event_t* data, int count);
+	bool waitRoom();
+
+public:
+	SensorReader(const struct SensorContext *context);
+	~SensorReader();
+	int start();
+	void stop();
+	void kick();
+	int getFd() const { return mNotifyFd; }
+	int readEvents(sensors_event_t* data, int count);
+	bool hasPendingEvents() const;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_READER_H
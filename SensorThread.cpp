@@ -0,0 +1,150 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "SensorThread.h"
+
+/*****************************************************************************/
+
+#define STACK_LOCK_SIZE		(64 * 1024)
+
+/* Apply the policy configured for role to the calling thread. Every setting
+ * is applied even if a previous one failed, the first error is returned.
+ */
+int SensorThread::applyPolicy(const char *role)
+{
+	char key[PROPERTY_KEY_MAX];
+	char value[PROPERTY_VALUE_MAX];
+	pid_t tid = syscall(__NR_gettid);
+	struct sched_param param;
+	cpu_set_t cpus;
+	unsigned long long mask;
+	int priority;
+	int err = 0;
+	int cpu;
+
+	snprintf(key, sizeof(key), "sensors.sched.%s.cpus", role);
+	property_get(key, value, "");
+	mask = strtoull(value, NULL, 16);
+	if (mask) {
+		CPU_ZERO(&cpus);
+		for (cpu = 0; (cpu < 64) && (cpu < CPU_SETSIZE); cpu++) {
+			if (mask & (1ULL << cpu))
+				CPU_SET(cpu, &cpus);
+		}
+		if (sched_setaffinity(tid, sizeof(cpus), &cpus)) {
+			ALOGE("set %s thread affinity to %s failed.(%s)\n", role, value, strerror(errno));
+			err = -errno;
+		}
+	}
+
+	snprintf(key, sizeof(key), "sensors.sched.%s.nice", role);
+	property_get(key, value, "");
+	if (strlen(value) && setpriority(PRIO_PROCESS, tid, atoi(value))) {
+		ALOGE("set %s thread nice to %s failed.(%s)\n", role, value, strerror(errno));
+		if (!err)
+			err = -errno;
+	}
+
+	snprintf(key, sizeof(key), "sensors.sched.%s.fifo", role);
+	property_get(key, value, "0");
+	priority = atoi(value);
+	if (priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = priority;
+		if (sched_setscheduler(tid, SCHED_FIFO, &param)) {
+			ALOGE("set %s thread SCHED_FIFO %d failed.(%s)\n", role, priority, strerror(errno));
+			if (!err)
+				err = -errno;
+		}
+	}
+
+	lockStack();
+
+	return err;
+}
+
+static bool lock_memory;
+static pthread_once_t lock_once = PTHREAD_ONCE_INIT;
+
+static void read_lock_property()
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	property_get("sensors.mlock", value, "0");
+	lock_memory = (strcmp(value, "1") == 0);
+}
+
+/* Lock the pages of [addr, addr + len) if sensors.mlock is set. The pages stay
+ * locked until they are unmapped.
+ */
+void SensorThread::lockBuffer(const void *addr, size_t len)
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)addr & ~(page - 1);
+
+	pthread_once(&lock_once, read_lock_property);
+	if (!lock_memory || !len)
+		return;
+
+	if (mlock((const void *)start, (uintptr_t)addr + len - start))
+		ALOGE("lock %zu bytes failed.(%s)\n", len, strerror(errno));
+}
+
+/* Lock STACK_LOCK_SIZE of the stack of the calling thread below the current
+ * frame, which is as deep as the event path goes.
+ */
+void SensorThread::lockStack()
+{
+	pthread_attr_t attr;
+	uintptr_t low, sp;
+	void *addr;
+	size_t size;
+
+	if (pthread_getattr_np(pthread_self(), &attr))
+		return;
+	pthread_attr_getstack(&attr, &addr, &size);
+	pthread_attr_destroy(&attr);
+
+	sp = (uintptr_t)&attr;
+	low = sp > STACK_LOCK_SIZE ? sp - STACK_LOCK_SIZE : 0;
+	if (low < (uintptr_t)addr)
+		low = (uintptr_t)addr;
+
+	lockBuffer((const void *)low, sp - low);
+}
@@ -0,0 +1,61 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_SENSOR_THREAD_H
+#define ANDROID_SENSOR_THREAD_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/* Scheduling of the HAL threads. The policy of a thread is read from the
+ * properties named after its role:
+ *   sensors.sched.<role>.fifo	SCHED_FIFO priority, 0 to keep SCHED_OTHER
+ *   sensors.sched.<role>.nice	nice level for SCHED_OTHER
+ *   sensors.sched.<role>.cpus	CPU mask in hex, empty to keep all the CPUs
+ * The roles are "poll" for the thread calling poll() and "reader" for the
+ * reader threads.
+ *
+ * If sensors.mlock is set, the stacks of these threads and the event buffers
+ * of the HAL are locked in memory, so that the event path does not page
+ * fault. The rest of the host process is left alone.
+ */
+class SensorThread {
+	static void lockStack();
+
+public:
+	static int applyPolicy(const char *role);
+	static void lockBuffer(const void *addr, size_t len);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_THREAD_H
@@ -0,0 +1,387 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/input.h>
+#include <cutils/log.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#include "NativeSensorManager.h"
+#include "SensorUring.h"
+
+/*****************************************************************************/
+
+SensorUring::SensorUring(int maxFds)
+	: mFd(-1),
+	  mSlots(new Slot[maxFds]),
+	  mSlotCount(0),
+	  mMaxSlots(maxFds),
+	  mBuffers(NULL),
+	  mToSubmit(0),
+	  mBlocking(false),
+	  mSyscalls(0),
+	  mReads(0),
+	  mSqRing(MAP_FAILED),
+	  mCqRing(MAP_FAILED),
+	  mSqes((struct io_uring_sqe *)MAP_FAILED)
+{
+}
+
+SensorUring::~SensorUring()
+{
+	restoreFlags();
+	if (mSqes != MAP_FAILED)
+		munmap(mSqes, mSqesSize);
+	if (mCqRing != MAP_FAILED)
+		munmap(mCqRing, mCqRingSize);
+	if (mSqRing != MAP_FAILED)
+		munmap(mSqRing, mSqRingSize);
+	if (mFd >= 0)
+		close(mFd);
+	delete [] mBuffers;
+	delete [] mSlots;
+}
+
+/* Return the slot reading the event device of ctx, or a negative errno */
+int SensorUring::addSensor(struct SensorContext *ctx)
+{
+	const Slot *slot;
+	int flags;
+
+	if ((mFd >= 0) || (mSlotCount >= mMaxSlots) || (ctx->data_fd < 0))
+		return -EINVAL;
+
+	/* Some sensors share the same event device */
+	slot = getSlot(ctx->data_fd);
+	if (slot != NULL)
+		return slot - mSlots;
+
+	/* Made blocking by start() once the ring is up */
+	flags = fcntl(ctx->data_fd, F_GETFL);
+	if (flags < 0)
+		return -errno;
+
+	mSlots[mSlotCount].ctx = ctx;
+	mSlots[mSlotCount].fd = ctx->data_fd;
+	mSlots[mSlotCount].flags = flags;
+	mSlots[mSlotCount].done = false;
+
+	return mSlotCount++;
+}
+
+/* io_uring fails the reads of a non blocking fd instead of waiting for data,
+ * and nothing else reads these fds once they are in the ring.
+ */
+int SensorUring::setBlocking()
+{
+	int i;
+
+	mBlocking = true;
+	for (i = 0; i < mSlotCount; i++) {
+		if (fcntl(mSlots[i].fd, F_SETFL, mSlots[i].flags & ~O_NONBLOCK))
+			return -errno;
+	}
+
+	return 0;
+}
+
+/* Give the fds back to read(2), which must not block the poll thread */
+void SensorUring::restoreFlags()
+{
+	int i;
+
+	if (!mBlocking)
+		return;
+
+	for (i = 0; i < mSlotCount; i++)
+		fcntl(mSlots[i].fd, F_SETFL, mSlots[i].flags);
+	mBlocking = false;
+}
+
+struct SensorUring::Slot* SensorUring::getSlot(int fd) const
+{
+	int i;
+
+	for (i = 0; i < mSlotCount; i++) {
+		if (mSlots[i].fd == fd)
+			return &mSlots[i];
+	}
+
+	return NULL;
+}
+
+void SensorUring::getStats(uint32_t *syscalls, uint32_t *reads)
+{
+	*syscalls = __atomic_exchange_n(&mSyscalls, 0, __ATOMIC_RELAXED);
+	*reads = __atomic_exchange_n(&mReads, 0, __ATOMIC_RELAXED);
+}
+
+bool SensorUring::hasData(int fd) const
+{
+	const Slot *slot = getSlot(fd);
+
+	return (slot != NULL) && __atomic_load_n(&slot->done, __ATOMIC_ACQUIRE);
+}
+
+#ifdef HAVE_IO_URING
+
+/* Set up the rings, register the buffers and start reading all the sensors.
+ * Fails on kernels without io_uring, the sensors are then read with read(2).
+ */
+int SensorUring::start()
+{
+	struct io_uring_params params;
+	struct iovec *iov;
+	char *sq, *cq;
+	int err;
+	int i;
+
+	if (!mSlotCount)
+		return -EINVAL;
+
+	memset(&params, 0, sizeof(params));
+	mFd = syscall(__NR_io_uring_setup, mSlotCount, &params);
+	if (mFd < 0) {
+		ALOGW("io_uring is not available.(%s)\n", strerror(errno));
+		return -errno;
+	}
+
+	mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	mSqRing = mmap(NULL, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			mFd, IORING_OFF_SQ_RING);
+	mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	mCqRing = mmap(NULL, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			mFd, IORING_OFF_CQ_RING);
+	mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	mSqes = (struct io_uring_sqe *)mmap(NULL, mSqesSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES);
+	if ((mSqRing == MAP_FAILED) || (mCqRing == MAP_FAILED) || (mSqes == MAP_FAILED)) {
+		ALOGE("map io_uring failed.(%s)\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	sq = (char *)mSqRing;
+	mSqHead = (uint32_t *)(sq + params.sq_off.head);
+	mSqTail = (uint32_t *)(sq + params.sq_off.tail);
+	mSqMask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+	mSqArray = (uint32_t *)(sq + params.sq_off.array);
+
+	cq = (char *)mCqRing;
+	mCqHead = (uint32_t *)(cq + params.cq_off.head);
+	mCqTail = (uint32_t *)(cq + params.cq_off.tail);
+	mCqMask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+	mCqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	/* Register the buffers once so the reads do not map them every time */
+	mBuffers = new input_event[mSlotCount * URING_READ_EVENTS];
+	iov = new iovec[mSlotCount];
+	for (i = 0; i < mSlotCount; i++) {
+		mSlots[i].buf = &mBuffers[i * URING_READ_EVENTS];
+		iov[i].iov_base = mSlots[i].buf;
+		iov[i].iov_len = URING_READ_EVENTS * sizeof(input_event);
+	}
+	err = syscall(__NR_io_uring_register, mFd, IORING_REGISTER_BUFFERS, iov, mSlotCount);
+	delete [] iov;
+	if (err) {
+		ALOGE("register io_uring buffers failed.(%s)\n", strerror(errno));
+		return -errno;
+	}
+
+	err = setBlocking();
+	if (err) {
+		ALOGE("clear O_NONBLOCK failed.(%s)\n", strerror(-err));
+		return err;
+	}
+
+	for (i = 0; i < mSlotCount; i++)
+		queueRead(&mSlots[i]);
+
+	err = submit();
+	if (err < 0)
+		return err;
+
+	return 0;
+}
+
+void SensorUring::queueRead(struct Slot *slot)
+{
+	uint32_t tail = *mSqTail;
+	uint32_t index = tail & mSqMask;
+	struct io_uring_sqe *sqe = &mSqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = slot->fd;
+	sqe->addr = (uint64_t)(uintptr_t)slot->buf;
+	sqe->len = URING_READ_EVENTS * sizeof(input_event);
+	sqe->buf_index = slot - mSlots;
+	sqe->user_data = slot - mSlots;
+	mSqArray[index] = index;
+
+	__atomic_store_n(&slot->done, false, __ATOMIC_RELEASE);
+	__atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+	mToSubmit++;
+}
+
+/* Submit the reads queued since the last call with a single syscall */
+int SensorUring::submit()
+{
+	int ret;
+
+	if (!mToSubmit)
+		return 0;
+
+	do {
+		__atomic_add_fetch(&mSyscalls, 1, __ATOMIC_RELAXED);
+		ret = syscall(__NR_io_uring_enter, mFd, mToSubmit, 0, 0, NULL, 0);
+	} while ((ret < 0) && (errno == EINTR));
+
+	if (ret < 0) {
+		ALOGE("io_uring submit failed.(%s)\n", strerror(errno));
+		return -errno;
+	}
+
+	mToSubmit -= ret;
+	return ret;
+}
+
+/* Move the completions to their slots, and return up to count of their
+ * sensors in ready.
+ */
+int SensorUring::reap(struct SensorContext **ready, int count)
+{
+	uint32_t head = *mCqHead;
+	uint32_t tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+	struct io_uring_cqe *cqe;
+	Slot *slot;
+	int nb = 0;
+
+	for (; head != tail; head++) {
+		cqe = &mCqes[head & mCqMask];
+		slot = &mSlots[cqe->user_data];
+		slot->res = cqe->res;
+		slot->offset = 0;
+		__atomic_store_n(&slot->done, true, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&mReads, 1, __ATOMIC_RELAXED);
+		if (nb < count)
+			ready[nb++] = slot->ctx;
+	}
+
+	__atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+
+	return nb;
+}
+
+int SensorUring::harvest(struct SensorContext **ready, int count)
+{
+	return reap(ready, count);
+}
+
+/* Copy out the data of the completed read of slot. Fails with EAGAIN like
+ * read(2) on the non blocking event device would if the read is in flight.
+ */
+ssize_t SensorUring::take(struct Slot *slot, void *buf, size_t len)
+{
+	int err;
+	int n;
+
+	if (!slot->done) {
+		submit();
+		reap(NULL, 0);
+		if (!slot->done) {
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+
+	if (slot->res <= 0) {
+		err = slot->res;
+		queueRead(slot);
+		if (err < 0) {
+			errno = -err;
+			return -1;
+		}
+		return 0;
+	}
+
+	n = slot->res - slot->offset;
+	if ((size_t)n > len)
+		n = len - len % sizeof(input_event);
+	memcpy(buf, (char *)slot->buf + slot->offset, n);
+	slot->offset += n;
+
+	if (slot->offset >= slot->res)
+		queueRead(slot);
+
+	return n;
+}
+
+#else
+
+int SensorUring::start()
+{
+	static bool logged;
+
+	ALOGW_IF(!logged, "io_uring is not supported by this build\n");
+	logged = true;
+	return -ENOSYS;
+}
+
+int SensorUring::submit()
+{
+	return 0;
+}
+
+int SensorUring::harvest(struct SensorContext **, int)
+{
+	return 0;
+}
+
+ssize_t SensorUring::take(struct Slot *, void *, size_t)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
+ssize_t SensorUring::read(int slot, void *buf, size_t len)
+{
+	return take(&mSlots[slot], buf, len);
+}
@@ -0,0 +1,115 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_SENSOR_URING_H
+#define ANDROID_SENSOR_URING_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+#define URING_READ_EVENTS	64 // input events per outstanding read
+
+struct SensorContext;
+struct input_event;
+
+/* An io_uring keeping one read outstanding on the event device of every
+ * sensor added to it, into buffers registered once. The completions of all
+ * the sensors are harvested from the shared completion ring without any
+ * syscall, and the reads consumed are resubmitted together with submit().
+ *
+ * The driver of every sensor added is given the ring and the slot of its fd,
+ * which InputEventCircularReader::fill() passes to read() to take the data of
+ * the completed read. The other drivers never look at the ring. All the calls
+ * on the ring must be serialized by the caller.
+ */
+class SensorUring
+{
+	struct Slot {
+		struct SensorContext *ctx;
+		int fd;
+		int flags; // file status flags of fd before it joined the ring
+		struct input_event *buf;
+		int res; // bytes read or negative errno, valid once done is set
+		int offset; // bytes already consumed
+		bool done;
+	};
+
+	int mFd;
+	struct Slot *mSlots;
+	int mSlotCount;
+	int mMaxSlots;
+	struct input_event *mBuffers;
+	int mToSubmit;
+	bool mBlocking; // the fds of the slots were made blocking
+	uint32_t mSyscalls; // io_uring_enter() calls, updated atomically
+	uint32_t mReads; // reads completed, updated atomically
+
+	void *mSqRing;
+	size_t mSqRingSize;
+	void *mCqRing;
+	size_t mCqRingSize;
+	struct io_uring_sqe *mSqes;
+	size_t mSqesSize;
+	uint32_t *mSqHead;
+	uint32_t *mSqTail;
+	uint32_t mSqMask;
+	uint32_t *mSqArray;
+	uint32_t *mCqHead;
+	uint32_t *mCqTail;
+	uint32_t mCqMask;
+	struct io_uring_cqe *mCqes;
+
+	struct Slot* getSlot(int fd) const;
+	void queueRead(struct Slot *slot);
+	int reap(struct SensorContext **ready, int count);
+	ssize_t take(struct Slot *slot, void *buf, size_t len);
+	int setBlocking();
+	void restoreFlags();
+
+public:
+	SensorUring(int maxFds);
+	~SensorUring();
+	int addSensor(struct SensorContext *ctx);
+	int start();
+	int getFd() const { return mFd; }
+	bool hasFd(int fd) const { return getSlot(fd) != NULL; }
+	int submit();
+	int harvest(struct SensorContext **ready, int count);
+	bool hasData(int fd) const;
+	/* The syscalls and the reads since the last call. Any thread. */
+	void getStats(uint32_t *syscalls, uint32_t *reads);
+	ssize_t read(int slot, void *buf, size_t len);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_URING_H
@@ -0,0 +1,93 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "SensorWakeLock.h"
+
+/*****************************************************************************/
+
+#define WAKE_LOCK_PATH		"/sys/power/wake_lock"
+#define WAKE_UNLOCK_PATH	"/sys/power/wake_unlock"
+
+SensorWakeLock* SensorWakeLock::create()
+{
+	char propBuf[PROPERTY_VALUE_MAX];
+
+	property_get("sensors.wakelock", propBuf, "sysfs");
+	if (!strcmp(propBuf, "local"))
+		return new LocalWakeLock();
+
+	return new SysfsWakeLock();
+}
+
+SysfsWakeLock::SysfsWakeLock()
+{
+	mLockFd = open(WAKE_LOCK_PATH, O_WRONLY | O_CLOEXEC);
+	ALOGE_IF(mLockFd<0, "open %s failed.(%s)\n", WAKE_LOCK_PATH, strerror(errno));
+	mUnlockFd = open(WAKE_UNLOCK_PATH, O_WRONLY | O_CLOEXEC);
+	ALOGE_IF(mUnlockFd<0, "open %s failed.(%s)\n", WAKE_UNLOCK_PATH, strerror(errno));
+}
+
+SysfsWakeLock::~SysfsWakeLock()
+{
+	if (mLockFd >= 0)
+		close(mLockFd);
+	if (mUnlockFd >= 0)
+		close(mUnlockFd);
+}
+
+int SysfsWakeLock::acquire()
+{
+	if (mLockFd < 0)
+		return -ENODEV;
+
+	if (write(mLockFd, SENSORS_WAKE_LOCK_NAME, strlen(SENSORS_WAKE_LOCK_NAME)) < 0) {
+		ALOGE("acquire wakelock failed.(%s)\n", strerror(errno));
+		return -errno;
+	}
+
+	return 0;
+}
+
+int SysfsWakeLock::release()
+{
+	if (mUnlockFd < 0)
+		return -ENODEV;
+
+	if (write(mUnlockFd, SENSORS_WAKE_LOCK_NAME, strlen(SENSORS_WAKE_LOCK_NAME)) < 0) {
+		ALOGE("release wakelock failed.(%s)\n", strerror(errno));
+		return -errno;
+	}
+
+	return 0;
+}
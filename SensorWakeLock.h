@@ -0,0 +1,84 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_SENSOR_WAKE_LOCK_H
+#define ANDROID_SENSOR_WAKE_LOCK_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+#define SENSORS_WAKE_LOCK_NAME	"SensorsHAL_WAKEUP"
+
+/* Keeps the AP awake while wake-up events are not delivered yet. The calls are
+ * serialized by the caller, and acquire() and release() alternate.
+ */
+class SensorWakeLock {
+public:
+	virtual ~SensorWakeLock() {}
+	virtual int acquire() = 0;
+	virtual int release() = 0;
+
+	/* The implementation selected by sensors.wakelock: "sysfs" (default)
+	 * for the kernel wakelock interface, "local" for a stand-in which only
+	 * counts, for the hosts without one.
+	 */
+	static SensorWakeLock* create();
+};
+
+/* The kernel wakelocks of /sys/power/wake_lock */
+class SysfsWakeLock : public SensorWakeLock {
+	int mLockFd;
+	int mUnlockFd;
+
+public:
+	SysfsWakeLock();
+	virtual ~SysfsWakeLock();
+	virtual int acquire();
+	virtual int release();
+};
+
+/* Tracks the state without touching the system */
+class LocalWakeLock : public SensorWakeLock {
+	uint32_t mAcquired;
+	bool mHeld;
+
+public:
+	LocalWakeLock() : mAcquired(0), mHeld(false) {}
+	virtual int acquire() { mAcquired++; mHeld = true; return 0; }
+	virtual int release() { mHeld = false; return 0; }
+	bool isHeld() const { return mHeld; }
+	uint32_t getAcquireCount() const { return mAcquired; }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_WAKE_LOCK_H
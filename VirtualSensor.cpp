@@ -102,24 +102,40 @@ int VirtualSensor::injectEvents(sensors_event_t* data, int count)
 	for (i = 0; i < count; i++) {
 		event = data[i];
 
-		if (mFreeSpace) {
-			sensors_event_t out;
-			if (algo->methods->convert(&event, &out, NULL))
-				continue;
-
-			out.version = sizeof(sensors_event_t);
-			out.sensor = context->sensor->handle;
-			out.type = context->sensor->type;
-			out.timestamp = event.timestamp;
-
-			*mWrite++ = out;
-			mFreeSpace--;
-			if (mWrite >= mBufferEnd) {
-				mWrite = mBuffer;
+		/* The source sensor feeds other consumers, never block it: under
+		 * the block policy the newest event is dropped instead.
+		 */
+		if (!mFreeSpace && (context->overload == OVERLOAD_BLOCK)) {
+			NativeSensorManager::countDropped(context, 1);
+			continue;
+		}
+
+		sensors_event_t out;
+		if (algo->methods->convert(&event, &out, NULL))
+			continue;
+
+		out.version = sizeof(sensors_event_t);
+		out.sensor = context->sensor->handle;
+		out.type = context->sensor->type;
+		out.timestamp = event.timestamp;
+
+		if (context->overload == OVERLOAD_KEEP_LATEST) {
+			if (!mFreeSpace) {
+				NativeSensorManager::countDropped(context, MAX_EVENTS);
+				mRead = mWrite;
+				mFreeSpace = MAX_EVENTS;
 			}
+		} else if (!mFreeSpace) {
+			NativeSensorManager::countDropped(context, 1);
+			if (++mRead >= mBufferEnd)
+				mRead = mBuffer;
+			mFreeSpace++;
+		}
 
-		} else {
-			ALOGW("Circular buffer is full\n");
+		*mWrite++ = out;
+		mFreeSpace--;
+		if (mWrite >= mBufferEnd) {
+			mWrite = mBuffer;
 		}
 	}
 
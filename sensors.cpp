@@ -26,9 +26,13 @@
 #include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <linux/input.h>
 #include <utils/Atomic.h>
 #include <utils/Log.h>
+#include <cutils/properties.h>
 #include <CalibrationManager.h>
 
 #include "sensors.h"
@@ -41,9 +45,22 @@
 #include "PressureSensor.h"
 
 #include "NativeSensorManager.h"
+#include "SensorThread.h"
 #include "sensors_extension.h"
 /*****************************************************************************/
 
+/* Sensors without a poll delay are scheduled as SENSOR_DELAY_NORMAL */
+#define SCHED_DEFAULT_DELAY_NS		200000000LL
+#define SCHED_REPORT_INTERVAL_NS	10000000000LL
+
+/* Room for the events of each sensor waiting to be merged by timestamp */
+#define MERGE_QUEUE_SIZE		256
+
+/* Weight of the last wakeup in the average interval between wakeups, as a shift */
+#define SPIN_AVG_SHIFT			3
+
+/*****************************************************************************/
+
 static int open_sensors(const struct hw_module_t* module, const char* id,
 						struct hw_device_t** device);
 
@@ -79,18 +96,88 @@ struct sensors_poll_context_t {
 
 		sensors_poll_context_t();
 		~sensors_poll_context_t();
+	int initCheck() const { return mClient != NULL ? 0 : -ENOMEM; };
 	int activate(int handle, int enabled);
 	int setDelay(int handle, int64_t ns);
 	int pollEvents(sensors_event_t* data, int count);
 	int calibrate(int handle, cal_cmd_t *para);
+	int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+	int flush(int handle);
+	int registerDirectChannel(int count, int format);
+	int getRawScale(int handle, struct sensors_raw_scale_t *scale);
+	int configDirectChannel(int handle, int64_t period_ns);
+	int registerCallback(sensors_event_callback_t callback, void *cookie);
 
 private:
-	static const size_t wake = MAX_SENSORS;
-	static const char WAKE_MESSAGE = 'W';
-	struct pollfd mPollFds[MAX_SENSORS+1];
-	int mWritePipeFd;
-	SensorBase* mSensors[MAX_SENSORS];
-	mutable Mutex mLock;
+	/* Per sensor scheduling state of pollEvents */
+	struct SchedState {
+		int64_t ready_ns; // when the sensor was first seen with data, 0 if drained
+		int64_t max_delay_ns; // worst queueing delay since the last report
+		int64_t total_delay_ns; // sum of the queueing delays since the last report
+		uint32_t serviced; // number of reads since the last report
+	};
+
+	/* When the staged events of a sensor were read. The events may be stamped
+	 * in another clock than CLOCK_MONOTONIC, so the reorder window runs from
+	 * their arrival instead. */
+	struct StageState {
+		int64_t arrival[MERGE_QUEUE_SIZE];
+		uint32_t staged; // number of events staged
+		uint32_t merged; // number of events merged
+	};
+
+	void armBatchTimer(int64_t deadline);
+
+	int readEvents(struct SensorContext *ctx, sensors_event_t* data, int count);
+	void schedule(struct SensorContext **list, int n);
+	void serviced(const struct SensorContext *ctx, int64_t now, bool drained);
+	void reportSchedStats(int64_t now);
+	void wake();
+	int stageSpace(int count);
+	void stage(int index, const sensors_event_t* data, int count, int64_t now);
+	void stageClientEvents(const sensors_event_t* data, int count, int64_t now);
+	int merge(sensors_event_t* data, int count, int64_t now);
+	int64_t getMergeDeadline();
+	bool imuActive();
+	int64_t spinBudget(int64_t now);
+	int spinWait(struct epoll_event *events, int count);
+	void wokenUp(int64_t now);
+	bool hasStagedWakeEvents();
+
+	struct SensorClient *mClient;
+	int mEpollFd;
+	int mWakeFd;
+	int mUringFd;
+	int mTimerFd;
+	int64_t mTimerDeadline;
+	uint32_t mWakeups;
+	uint32_t mReturns;
+	int mSensorCount;
+	struct SchedState *mSched;
+	int mRoundRobin;
+	bool mSchedDebug;
+	int64_t mLastReport;
+	bool mOrdered;
+	int64_t mReorderWindow;
+	SensorEventQueue **mStaged;
+	struct StageState *mStage;
+	int64_t mSpinMax;
+	int64_t mLastWakeup;
+	int64_t mWakeupInterval;
+	uint32_t mSpinHits;
+	uint32_t mSpinMisses;
+	bool mPolicyApplied;
+	pthread_t mPollThread;
+	/* Scratch space of pollEvents and schedule(), sized to the sensors here
+	 * so that polling never allocates */
+	uint32_t *mActive;
+	uint32_t *mSeen;
+	struct SensorContext **mReady;
+	struct SensorContext **mList;
+	struct epoll_event *mEvents;
+	int64_t *mDeadline;
+	int *mRank;
+	bool *mWakeFirst;
 };
 
 /*****************************************************************************/
@@ -99,117 +186,682 @@ sensors_poll_context_t::sensors_poll_context_t()
 {
 	int number;
 	int i;
+	int fd;
 	const struct sensor_t *slist;
-	const struct SensorContext *context;
+	struct SensorContext *context;
+	struct epoll_event ev;
+	char propBuf[PROPERTY_VALUE_MAX];
 	NativeSensorManager& sm(NativeSensorManager::getInstance());
 
+	mSensorCount = sm.getSensorCount();
+	mSched = new SchedState[mSensorCount];
+	memset(mSched, 0, mSensorCount * sizeof(mSched[0]));
+	mActive = new uint32_t[sm.getMaskWords()];
+	mSeen = new uint32_t[sm.getMaskWords()];
+	mReady = new SensorContext*[mSensorCount];
+	mList = new SensorContext*[mSensorCount];
+	mEvents = new epoll_event[mSensorCount + 1];
+	mDeadline = new int64_t[mSensorCount];
+	mRank = new int[mSensorCount];
+	mWakeFirst = new bool[mSensorCount];
+	mRoundRobin = 0;
+	mLastReport = 0;
+	mTimerDeadline = -1;
+	mWakeups = 0;
+	mReturns = 0;
+	property_get("sensors.sched.debug", propBuf, "0");
+	mSchedDebug = (strcmp(propBuf, "1") == 0);
+
+	/* Merge the events of all the sensors by timestamp before returning them,
+	 * holding them back up to the reorder window for late sensors */
+	property_get("sensors.poll.ordered", propBuf, "0");
+	mOrdered = (strcmp(propBuf, "1") == 0);
+	property_get("sensors.poll.reorder_window", propBuf, "0");
+	mReorderWindow = atoi(propBuf) * 1000000LL;
+	mStaged = new SensorEventQueue*[mSensorCount]();
+	mStage = mOrdered ? new StageState[mSensorCount]() : NULL;
+
+	/* Spin up to sensors.poll.spin_us before sleeping while an IMU is active */
+	property_get("sensors.poll.spin_us", propBuf, "0");
+	mSpinMax = atoi(propBuf) * 1000LL;
+	mLastWakeup = 0;
+	mWakeupInterval = 0;
+	mSpinHits = 0;
+	mSpinMisses = 0;
+	mPolicyApplied = false;
+	for (i = 0; mOrdered && (i < sm.getSensorCount()); i++)
+		mStaged[i] = new SensorEventQueue(MERGE_QUEUE_SIZE);
+
+	mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	ALOGE_IF(mEpollFd<0, "error creating epoll fd (%s)", strerror(errno));
+
+	/* Every poll context is a client of the shared sensors */
+	mClient = sm.registerClient();
+	if (mClient != NULL) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = &mClient;
+		if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mClient->notify_fd, &ev))
+			ALOGE("error adding client fd to epoll (%s)", strerror(errno));
+	}
+
 	number = sm.getSensorList(&slist);
 
 	/* use the dynamic sensor list */
 	for (i = 0; i < number; i++) {
 		context = sm.getInfoByHandle(slist[i].handle);
+		if ((context == NULL) || (context->data_fd < 0))
+			continue;
+
+		/* The io_uring reads the device, its fd is added once below */
+		if (sm.readsWithUring(context))
+			continue;
 
-		mPollFds[i].fd = (context == NULL) ? -1 : context->data_fd;
-		mPollFds[i].events = POLLIN;
-		mPollFds[i].revents = 0;
+		/* Wait on the reader queue instead of the device if it has a reader */
+		fd = (context->reader != NULL) ? context->reader->getFd() : context->data_fd;
+		ev.events = EPOLLIN;
+		ev.data.ptr = context;
+		if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev))
+			ALOGE("error adding %s to epoll (%s)", slist[i].name, strerror(errno));
 	}
 
 	ALOGI("The avaliable sensor handle number is %d",i);
-	int wakeFds[2];
-	int result = pipe(wakeFds);
-	ALOGE_IF(result<0, "error creating wake pipe (%s)", strerror(errno));
-	fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
-	fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
-	mWritePipeFd = wakeFds[1];
 
-	mPollFds[number].fd = wakeFds[0];
-	mPollFds[number].events = POLLIN;
-	mPollFds[number].revents = 0;
+	/* The wake fd is the only one registered without a sensor context */
+	mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ALOGE_IF(mWakeFd<0, "error creating wake eventfd (%s)", strerror(errno));
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev))
+		ALOGE("error adding wake eventfd to epoll (%s)", strerror(errno));
+
+	/* The io_uring completions of all the sensors wake up on a single fd */
+	mUringFd = sm.getUringFd();
+	if (mUringFd >= 0) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = &mUringFd;
+		if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mUringFd, &ev))
+			ALOGE("error adding io_uring fd to epoll (%s)", strerror(errno));
+	}
+
+	/* One timer for the batch deadline of all the sensors */
+	mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	ALOGE_IF(mTimerFd<0, "error creating batch timerfd (%s)", strerror(errno));
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &mTimerFd;
+	if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mTimerFd, &ev))
+		ALOGE("error adding batch timerfd to epoll (%s)", strerror(errno));
 }
 
 sensors_poll_context_t::~sensors_poll_context_t() {
-	NativeSensorManager& sm(NativeSensorManager::getInstance());
-	int number = sm.getSensorCount();
-
-	close(mPollFds[number].fd);
-	close(mWritePipeFd);
+	if (mClient != NULL)
+		NativeSensorManager::getInstance().unregisterClient(mClient);
+	for (int i = 0; i < mSensorCount; i++)
+		delete mStaged[i];
+	delete [] mStaged;
+	delete [] mStage;
+	delete [] mSched;
+	delete [] mActive;
+	delete [] mSeen;
+	delete [] mReady;
+	delete [] mList;
+	delete [] mEvents;
+	delete [] mDeadline;
+	delete [] mRank;
+	delete [] mWakeFirst;
+	close(mTimerFd);
+	close(mWakeFd);
+	close(mEpollFd);
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled) {
 	int err = -1;
 	NativeSensorManager& sm(NativeSensorManager::getInstance());
-	Mutex::Autolock _l(mLock);
 
-	err = sm.activate(handle, enabled);
-	if (enabled && !err) {
-		const char wakeMessage(WAKE_MESSAGE);
-		int result = write(mWritePipeFd, &wakeMessage, 1);
-		ALOGE_IF(result<0, "error sending wake message (%s)", strerror(errno));
-	}
+	err = sm.activate(mClient, handle, enabled);
+	if (enabled && !err)
+		wake();
 
 	return err;
 }
 
+/* Make the poll thread look at the pending events again */
+void sensors_poll_context_t::wake()
+{
+	const uint64_t wakeMessage = 1;
+	int result = write(mWakeFd, &wakeMessage, sizeof(wakeMessage));
+	ALOGE_IF(result<0, "error sending wake message (%s)", strerror(errno));
+}
+
 int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
 	int err = -1;
 	NativeSensorManager& sm(NativeSensorManager::getInstance());
-	Mutex::Autolock _l(mLock);
 
-	err = sm.setDelay(handle, ns);
+	err = sm.setDelay(mClient, handle, ns);
 
 	return err;
 }
 
+int sensors_poll_context_t::readEvents(struct SensorContext *ctx,
+		sensors_event_t* data, int count)
+{
+	int nb = NativeSensorManager::getInstance().readEvents(mClient,
+			ctx->sensor->handle, data, count);
+
+	ALOGE_IF(nb < 0, "readEvents failed.(%d)", errno);
+	return nb;
+}
+
+/* Order the sensors with data by their deadline, which is the time they were
+ * first seen with data plus their poll delay. Sensors with the same deadline
+ * are served round robin, starting from a different index on every call.
+ * The wake-up sensors go first, so the wakelock is held for less time.
+ */
+void sensors_poll_context_t::schedule(struct SensorContext **list, int n)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	int64_t *deadline = mDeadline;
+	int *rank = mRank;
+	bool *wake = mWakeFirst;
+	struct SensorContext *ctx;
+	int64_t delay_ns, d;
+	int i, j, r;
+	bool w;
+
+	if (!n)
+		return;
+
+	for (i = 0; i < n; i++) {
+		ctx = list[i];
+		delay_ns = sm.getDelay(ctx);
+		if (delay_ns <= 0)
+			delay_ns = SCHED_DEFAULT_DELAY_NS;
+		d = mSched[ctx->index].ready_ns + delay_ns;
+		r = (ctx->index - mRoundRobin + mSensorCount) % mSensorCount;
+		w = ctx->wake_up;
+
+		/* insertion sort, n is small */
+		for (j = i; j > 0; j--) {
+			if ((wake[j - 1] && !w) || ((wake[j - 1] == w) && ((deadline[j - 1] < d) ||
+						((deadline[j - 1] == d) && (rank[j - 1] < r)))))
+				break;
+			list[j] = list[j - 1];
+			deadline[j] = deadline[j - 1];
+			rank[j] = rank[j - 1];
+			wake[j] = wake[j - 1];
+		}
+		list[j] = ctx;
+		deadline[j] = d;
+		rank[j] = r;
+		wake[j] = w;
+	}
+
+	mRoundRobin = (mRoundRobin + 1) % mSensorCount;
+}
+
+void sensors_poll_context_t::serviced(const struct SensorContext *ctx,
+		int64_t now, bool drained)
+{
+	struct SchedState *sched = &mSched[ctx->index];
+	int64_t delay_ns = now - sched->ready_ns;
+
+	if (delay_ns > sched->max_delay_ns)
+		sched->max_delay_ns = delay_ns;
+	sched->total_delay_ns += delay_ns;
+	sched->serviced++;
+
+	/* Keep the deadline of a sensor with leftover so it gets ahead next time */
+	if (drained)
+		sched->ready_ns = 0;
+}
+
+/* Arm the batch timer at deadline, or disarm it if deadline is -1 */
+void sensors_poll_context_t::armBatchTimer(int64_t deadline)
+{
+	struct itimerspec spec;
+
+	if (deadline == mTimerDeadline)
+		return;
+
+	memset(&spec, 0, sizeof(spec));
+	if (deadline >= 0) {
+		/* 0 would disarm the timer */
+		if (deadline == 0)
+			deadline = 1;
+		spec.it_value.tv_sec = deadline / 1000000000LL;
+		spec.it_value.tv_nsec = deadline % 1000000000LL;
+	}
+
+	if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, NULL))
+		ALOGE("error arming batch timer (%s)", strerror(errno));
+	else
+		mTimerDeadline = deadline;
+}
+
+void sensors_poll_context_t::reportSchedStats(int64_t now)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	struct SchedState *sched;
+	int number = sm.getSensorCount();
+	uint32_t syscalls, reads;
+	int i;
+
+	if (now - mLastReport < SCHED_REPORT_INTERVAL_NS)
+		return;
+
+	if (mLastReport) {
+		ALOGI("%lld wakeups/s, %lld poll returns/s",
+				mWakeups * 1000000000LL / (now - mLastReport),
+				mReturns * 1000000000LL / (now - mLastReport));
+	}
+	mWakeups = 0;
+	mReturns = 0;
+
+	if (mSpinMax) {
+		ALOGI("spin wait: %u hits, %u misses, wakeup interval %lld us",
+				mSpinHits, mSpinMisses, mWakeupInterval / 1000);
+		mSpinHits = 0;
+		mSpinMisses = 0;
+	}
+
+	/* With read(2), every read is a syscall on top of epoll_wait() */
+	if (sm.getUringStats(&syscalls, &reads))
+		ALOGI("io_uring: %u reads in %u syscalls", reads, syscalls);
+
+	for (i = 0; i < number; i++) {
+		sched = &mSched[i];
+		if (!sched->serviced)
+			continue;
+		ALOGI("%s: queueing delay avg %lld us, max %lld us, %u reads, %u dropped",
+				sm.getInfoByIndex(i)->sensor->name,
+				sched->total_delay_ns / sched->serviced / 1000,
+				sched->max_delay_ns / 1000, sched->serviced,
+				sm.getDropCount(sm.getInfoByIndex(i)));
+		sched->max_delay_ns = 0;
+		sched->total_delay_ns = 0;
+		sched->serviced = 0;
+	}
+
+	mLastReport = now;
+}
+
+/* The number of events, up to count, that can be staged for any sensor */
+int sensors_poll_context_t::stageSpace(int count)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	int number = sm.getSensorCount();
+	int space;
+	int i;
+
+	for (i = 0; i < number; i++) {
+		space = mStaged[i]->capacity() - mStaged[i]->available();
+		if (space < count)
+			count = space;
+	}
+
+	return count;
+}
+
+/* Stage count events of the sensor at index, which arrived at now */
+void sensors_poll_context_t::stage(int index, const sensors_event_t* data, int count,
+		int64_t now)
+{
+	struct StageState *s = &mStage[index];
+	int i;
+
+	count = mStaged[index]->write(data, count);
+	for (i = 0; i < count; i++)
+		s->arrival[s->staged++ % MERGE_QUEUE_SIZE] = now;
+}
+
+/* Stage the events read for us by the other clients, which mix the sensors */
+void sensors_poll_context_t::stageClientEvents(const sensors_event_t* data, int count,
+		int64_t now)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	struct SensorContext *ctx;
+	int handle;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		handle = (data[i].type == SENSOR_TYPE_META_DATA) ?
+			data[i].meta_data.sensor : data[i].sensor;
+		ctx = sm.getInfoByHandle(handle);
+		if (ctx != NULL)
+			stage(ctx->index, &data[i], 1, now);
+	}
+}
+
+/* k-way merge of the staged events by timestamp. The events of each sensor
+ * are already in order, so only the oldest one of each sensor is compared.
+ * Once the oldest event arrived less than the reorder window before now, the
+ * rest is left for a later call.
+ */
+int sensors_poll_context_t::merge(sensors_event_t* data, int count, int64_t now)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	int number = sm.getSensorCount();
+	const sensors_event_t *head, *oldest;
+	int i, best = 0;
+	int nb = 0;
+
+	while (nb < count) {
+		oldest = NULL;
+		for (i = 0; i < number; i++) {
+			head = mStaged[i]->peek();
+			if ((head != NULL) && ((oldest == NULL) || (head->timestamp < oldest->timestamp))) {
+				oldest = head;
+				best = i;
+			}
+		}
+
+		if ((oldest == NULL) || (mReorderWindow &&
+					(mStage[best].arrival[mStage[best].merged % MERGE_QUEUE_SIZE] >
+					 now - mReorderWindow)))
+			break;
+
+		mStaged[best]->read(&data[nb++], 1);
+		mStage[best].merged++;
+	}
+
+	return nb;
+}
+
+/* The time at which the oldest staged event leaves the reorder window, or -1 */
+int64_t sensors_poll_context_t::getMergeDeadline()
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	int number = sm.getSensorCount();
+	int64_t deadline = -1;
+	int64_t t;
+	int i;
+
+	for (i = 0; mOrdered && (i < number); i++) {
+		if (!mStaged[i]->available())
+			continue;
+		t = mStage[i].arrival[mStage[i].merged % MERGE_QUEUE_SIZE] + mReorderWindow;
+		if ((deadline < 0) || (t < deadline))
+			deadline = t;
+	}
+
+	return deadline;
+}
+
+bool sensors_poll_context_t::imuActive()
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	uint32_t *active = mActive;
+	uint32_t bits;
+	int type;
+	int w;
+
+	sm.getActiveMask(active);
+	for (w = 0; w < sm.getMaskWords(); w++) {
+		for (bits = active[w]; bits; bits &= bits - 1) {
+			type = sm.getInfoByIndex(w * 32 + __builtin_ctz(bits))->sensor->type;
+			if ((type == SENSOR_TYPE_ACCELEROMETER) || (type == SENSOR_TYPE_GYROSCOPE) ||
+					(type == SENSOR_TYPE_GYROSCOPE_UNCALIBRATED))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/* How long to spin before sleeping: until a quarter of the average interval
+ * after the next wakeup is expected. No spinning if it is not expected within
+ * the maximum budget, sleeping is cheaper then.
+ */
+int64_t sensors_poll_context_t::spinBudget(int64_t now)
+{
+	int64_t until;
+
+	if (!mWakeupInterval || (mWakeupInterval > mSpinMax))
+		return 0;
+
+	until = mLastWakeup + mWakeupInterval - now;
+	if (until > mSpinMax)
+		return 0;
+	if (until < 0)
+		until = 0;
+
+	until += mWakeupInterval / 4;
+	return until > mSpinMax ? mSpinMax : until;
+}
+
+/* Poll the fds without sleeping for the spin budget. Returns the number of
+ * events, or 0 if there was none in time.
+ */
+int sensors_poll_context_t::spinWait(struct epoll_event *events, int count)
+{
+	int64_t now = SensorBase::getTimestamp();
+	int64_t end = now + spinBudget(now);
+	int n;
+
+	if (end == now)
+		return 0;
+
+	do {
+		n = epoll_wait(mEpollFd, events, count, 0);
+		if (n > 0) {
+			mSpinHits++;
+			return n;
+		}
+		if ((n < 0) && (errno != EINTR))
+			return 0;
+	} while (SensorBase::getTimestamp() < end);
+
+	mSpinMisses++;
+	return 0;
+}
+
+void sensors_poll_context_t::wokenUp(int64_t now)
+{
+	if (mLastWakeup)
+		mWakeupInterval += (now - mLastWakeup - mWakeupInterval) >> SPIN_AVG_SHIFT;
+	mLastWakeup = now;
+	mWakeups++;
+}
+
+bool sensors_poll_context_t::hasStagedWakeEvents()
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	int number = sm.getSensorCount();
+	int i;
+
+	for (i = 0; mOrdered && (i < number); i++) {
+		if (sm.getInfoByIndex(i)->wake_up && mStaged[i]->available())
+			return true;
+	}
+
+	return false;
+}
+
 int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 {
 	int nbEvents = 0;
 	int n = 0;
+	int nReady = 0;
+	int nList;
+	int nb;
+	int limit;
+	int i, w;
+	int64_t now;
+	int64_t deadline;
+	int64_t held;
+	uint32_t bits;
+	uint32_t *active = mActive;
+	uint32_t *seen = mSeen;
+	struct SensorContext **ready = mReady;
+	struct SensorContext **list = mList;
+	struct epoll_event *events = mEvents;
+	struct SensorContext *ctx;
 	NativeSensorManager& sm(NativeSensorManager::getInstance());
-	const sensor_t *slist;
-	int number = sm.getSensorList(&slist);
+
+	/* The poll thread belongs to the framework, it is only known from here */
+	if (!mPolicyApplied || !pthread_equal(mPollThread, pthread_self())) {
+		SensorThread::applyPolicy("poll");
+		mPollThread = pthread_self();
+		mPolicyApplied = true;
+	}
 
 	do {
-		// see if we have some leftover from the last poll()
-		for (int i = 0 ; count && i < number ; i++) {
-			if ((mPollFds[i].revents & POLLIN) || (sm.hasPendingEvents(slist[i].handle))) {
-				Mutex::Autolock _l(mLock);
-				int nb = sm.readEvents(slist[i].handle, data, count);
-				if (nb < 0) {
-					ALOGE("readEvents failed.(%d)", errno);
-					return nb;
-				}
-				if (nb <= count) {
-					// no more data for this sensor
-					mPollFds[i].revents = 0;
-				}
+		now = SensorBase::getTimestamp();
+		nList = 0;
+		memset(seen, 0, sm.getMaskWords() * sizeof(seen[0]));
+
+		// deliver all the batches together once one of them is due
+		deadline = sm.getBatchDeadline();
+		if ((deadline >= 0) && (deadline <= now))
+			sm.releaseBatches(now);
+
+		// the sensors reported by the last epoll_wait()
+		for (i = 0; i < nReady; i++) {
+			ctx = ready[i];
+			if (seen[ctx->index / 32] & (1U << (ctx->index % 32)))
+				continue;
+			seen[ctx->index / 32] |= 1U << (ctx->index % 32);
+			list[nList++] = ctx;
+		}
+		nReady = 0;
+
+		// the events read for us by the other clients come first, they
+		// already waited for the other client to be scheduled
+		if (count && sm.hasClientEvents(mClient)) {
+			limit = mOrdered ? stageSpace(count) : count;
+			nb = sm.readClientEvents(mClient, data, limit);
+			if (mOrdered) {
+				stageClientEvents(data, nb, now);
+			} else {
 				count -= nb;
 				nbEvents += nb;
 				data += nb;
 			}
 		}
 
+		// see if the active sensors have some leftover
+		sm.getActiveMask(active);
+		for (w = 0; w < sm.getMaskWords(); w++) {
+			for (bits = active[w] & ~seen[w]; bits; bits &= bits - 1) {
+				ctx = sm.getInfoByIndex(w * 32 + __builtin_ctz(bits));
+				if (sm.hasPendingEvents(ctx->sensor->handle))
+					list[nList++] = ctx;
+			}
+		}
+
+		for (i = 0; i < nList; i++) {
+			if (!mSched[list[i]->index].ready_ns)
+				mSched[list[i]->index].ready_ns = now;
+		}
+
+		// drain them earliest deadline first
+		schedule(list, nList);
+		for (i = 0; count && i < nList; i++) {
+			/* In ordered mode the caller buffer is only used to stage them */
+			limit = count;
+			if (mOrdered) {
+				limit = mStaged[list[i]->index]->capacity() -
+					mStaged[list[i]->index]->available();
+				if (limit > count)
+					limit = count;
+				if (!limit)
+					continue;
+			}
+			nb = readEvents(list[i], data, limit);
+			if (nb < 0)
+				return nb;
+			serviced(list[i], now, nb < limit);
+			if (mOrdered) {
+				stage(list[i]->index, data, nb, SensorBase::getTimestamp());
+				continue;
+			}
+			count -= nb;
+			nbEvents += nb;
+			data += nb;
+		}
+
+		if (mOrdered) {
+			nb = merge(data, count, SensorBase::getTimestamp());
+			count -= nb;
+			nbEvents += nb;
+			data += nb;
+		}
+
+		if (mSchedDebug)
+			reportSchedStats(now);
+
 		if (count) {
 			// we still have some room, so try to see if we can get
 			// some events immediately or just wait if we don't have
-			// anything to return
-			do {
-				n = poll(mPollFds, number + 1, nbEvents ? 0 : -1);
-			} while (n < 0 && errno == EINTR);
+			// anything to return, until the batch timer fires at the
+			// earliest batch deadline. The fds are level triggered, so
+			// the ones we have no room for are reported again next time.
+
+			// the reads consumed above are resubmitted together
+			if (mUringFd >= 0)
+				sm.submitReads();
+			if (!nbEvents) {
+				deadline = sm.getBatchDeadline();
+				held = getMergeDeadline();
+				if ((held >= 0) && ((deadline < 0) || (held < deadline)))
+					deadline = held;
+				armBatchTimer(deadline);
+			}
+			// trade some CPU for not going through the scheduler if
+			// the next IMU sample is close
+			n = 0;
+			if (!nbEvents && mSpinMax && imuActive())
+				n = spinWait(events, mSensorCount + 1);
+			if (!n) {
+				do {
+					n = epoll_wait(mEpollFd, events, mSensorCount + 1, nbEvents ? 0 : -1);
+				} while (n < 0 && errno == EINTR);
+			}
 			if (n<0) {
-				ALOGE("poll() failed (%s)", strerror(errno));
+				ALOGE("epoll_wait() failed (%s)", strerror(errno));
 				return -errno;
 			}
-			if (mPollFds[number].revents & POLLIN) {
-				char msg;
-				int result = read(mPollFds[number].fd, &msg, 1);
-				ALOGE_IF(result<0, "error reading from wake pipe (%s)", strerror(errno));
-				ALOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
-				mPollFds[number].revents = 0;
+			if (!nbEvents)
+				wokenUp(SensorBase::getTimestamp());
+			for (i = 0; i < n; i++) {
+				if (events[i].data.ptr == &mTimerFd) {
+					uint64_t expirations;
+					read(mTimerFd, &expirations, sizeof(expirations));
+					mTimerDeadline = -1;
+					continue;
+				}
+				if (events[i].data.ptr == &mClient)
+					continue;
+				if (events[i].data.ptr == &mUringFd) {
+					nReady += sm.harvestReads(&ready[nReady], mSensorCount - nReady);
+					continue;
+				}
+				ctx = (struct SensorContext *)events[i].data.ptr;
+				if (ctx == NULL) {
+					uint64_t msg;
+					int result = read(mWakeFd, &msg, sizeof(msg));
+					ALOGE_IF(result<0, "error reading from wake eventfd (%s)", strerror(errno));
+					continue;
+				}
+				ready[nReady++] = ctx;
 			}
 		}
 		// if we have events and space, go read them
 	} while (n && count);
 
+	// the framework holds its own wakelock for the wake-up events returned,
+	// so ours is only needed while some are still in the HAL
+	if (sm.isWakeLockHeld()) {
+		uint32_t seq = sm.getWakeSequence();
+		if (!sm.hasWakeEvents() && !hasStagedWakeEvents())
+			sm.releaseWakeLock(seq);
+	}
+
+	// slow down the sensors the framework does not keep up with
+	sm.adaptRates(SensorBase::getTimestamp());
+
+	mReturns++;
 	return nbEvents;
 }
 
@@ -218,13 +870,66 @@ int sensors_poll_context_t::calibrate(int handle, struct cal_cmd_t *para)
 
 	int err = -1;
 	NativeSensorManager& sm(NativeSensorManager::getInstance());
-	Mutex::Autolock _l(mLock);
 
 	err = sm.calibrate(handle, para);
 
 	return err;
 }
 
+int sensors_poll_context_t::batch(int handle, int flags, int64_t period_ns,
+		int64_t timeout)
+{
+	int err;
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+
+	err = sm.batch(mClient, handle, flags, period_ns, timeout);
+	/* The batch deadline may be earlier than what the poll thread waits for */
+	if (!err && !(flags & SENSORS_BATCH_DRY_RUN))
+		wake();
+
+	return err;
+}
+
+int sensors_poll_context_t::flush(int handle)
+{
+	int err;
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+
+	err = sm.flush(mClient, handle);
+	if (!err)
+		wake();
+
+	return err;
+}
+
+int sensors_poll_context_t::registerDirectChannel(int count, int format)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+
+	return sm.registerDirectChannel(mClient, count, format);
+}
+
+int sensors_poll_context_t::getRawScale(int handle, struct sensors_raw_scale_t *scale)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+
+	return sm.getRawScale(handle, scale);
+}
+
+int sensors_poll_context_t::configDirectChannel(int handle, int64_t period_ns)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+
+	return sm.configDirectChannel(mClient, handle, period_ns);
+}
+
+int sensors_poll_context_t::registerCallback(sensors_event_callback_t callback, void *cookie)
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+
+	return sm.registerCallback(mClient, callback, cookie);
+}
+
 /*****************************************************************************/
 
 static int poll__close(struct hw_device_t *dev)
@@ -254,12 +959,60 @@ static int poll__poll(struct sensors_poll_device_t *dev,
 	return ctx->pollEvents(data, count);
 }
 
+static int poll__batch(struct sensors_poll_device_1 *dev,
+		int handle, int flags, int64_t period_ns, int64_t timeout)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->batch(handle, flags, period_ns, timeout);
+}
+
+static int poll__flush(struct sensors_poll_device_1 *dev, int handle)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->flush(handle);
+}
+
 static int poll_calibrate(struct sensors_poll_device_1_ext_t *dev,
 		int handle, struct cal_cmd_t *para)
 {
 	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
 	return ctx->calibrate(handle, para);
 }
+
+static int poll_register_direct_channel(struct sensors_poll_device_1_ext_t *dev,
+		int count)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->registerDirectChannel(count, SENSORS_DIRECT_FORMAT_EVENT);
+}
+
+static int poll_register_raw_channel(struct sensors_poll_device_1_ext_t *dev,
+		int count)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->registerDirectChannel(count, SENSORS_DIRECT_FORMAT_RAW);
+}
+
+static int poll_get_raw_scale(struct sensors_poll_device_1_ext_t *dev,
+		int handle, struct sensors_raw_scale_t *scale)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->getRawScale(handle, scale);
+}
+
+static int poll_config_direct_channel(struct sensors_poll_device_1_ext_t *dev,
+		int handle, int64_t period_ns)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->configDirectChannel(handle, period_ns);
+}
+
+static int poll_register_event_callback(struct sensors_poll_device_1_ext_t *dev,
+		sensors_event_callback_t callback, void *cookie)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->registerCallback(callback, cookie);
+}
 /*****************************************************************************/
 
 /** Open a new instance of a sensor device using name */
@@ -267,18 +1020,37 @@ static int open_sensors(const struct hw_module_t* module, const char*,
 						struct hw_device_t** device)
 {
 		int status = -EINVAL;
+
 		sensors_poll_context_t *dev = new sensors_poll_context_t();
 
+		if (dev->initCheck()) {
+			ALOGE("No room for another sensors client");
+			delete dev;
+			return -ENOMEM;
+		}
+
 		memset(&dev->device, 0, sizeof(sensors_poll_device_1_ext_t));
 
 		dev->device.common.tag = HARDWARE_DEVICE_TAG;
-		dev->device.common.version  = 0;
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+		/* The sensor flags are only looked at from 1.3 on */
+		dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_3;
+#else
+		dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_1;
+#endif
 		dev->device.common.module   = const_cast<hw_module_t*>(module);
 		dev->device.common.close	= poll__close;
 		dev->device.activate		= poll__activate;
 		dev->device.setDelay		= poll__setDelay;
 		dev->device.poll			= poll__poll;
+		dev->device.batch			= poll__batch;
+		dev->device.flush			= poll__flush;
 		dev->device.calibrate		= poll_calibrate;
+		dev->device.register_direct_channel	= poll_register_direct_channel;
+		dev->device.config_direct_channel	= poll_config_direct_channel;
+		dev->device.register_event_callback	= poll_register_event_callback;
+		dev->device.register_raw_channel	= poll_register_raw_channel;
+		dev->device.get_raw_scale	= poll_get_raw_scale;
 
 		*device = &dev->device.common;
 		status = 0;
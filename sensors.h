@@ -41,9 +41,10 @@ __BEGIN_DECLS
 #define SENSORS_GYROSCOPE_HANDLE		5
 #define SENSORS_PRESSURE_HANDLE			6
 
-#define MAX_SENSORS		(20)
 #define SYSFS_MAXLEN		(20)
+#ifndef SYSFS_CLASS
 #define SYSFS_CLASS		"/sys/class/sensors/"
+#endif
 #define SYSFS_NAME		"name"
 #define SYSFS_VENDOR		"vendor"
 #define SYSFS_VERSION		"version"
@@ -57,6 +58,7 @@ __BEGIN_DECLS
 #define SYSFS_POLL_DELAY	"poll_delay"
 #define SYSFS_CALIBRATE		"calibrate"
 #define SYSFS_CAL_PARAMS	"cal_params"
+#define SYSFS_WAKEUP		"wakeup"
 
 #define COMPASS_VENDOR_AKM		"AKM"
 #define COMPASS_VENDOR_ALPS		"Alps"
@@ -148,6 +150,107 @@ static inline const char* type_to_name(int type)
 	}
 }
 
+/* Helper function to convert sensor type to the short name used in the
+ * property keys, which are limited to PROPERTY_KEY_MAX - 1 characters */
+static inline const char* type_to_token(int type)
+{
+	switch (type) {
+		case SENSOR_TYPE_ACCELEROMETER:
+			return "accel";
+		case SENSOR_TYPE_GEOMAGNETIC_FIELD:
+			return "mag";
+		case SENSOR_TYPE_ORIENTATION:
+			return "orient";
+		case SENSOR_TYPE_GYROSCOPE:
+			return "gyro";
+		case SENSOR_TYPE_LIGHT:
+			return "light";
+		case SENSOR_TYPE_PRESSURE:
+			return "press";
+		case SENSOR_TYPE_TEMPERATURE:
+			return "temp";
+		case SENSOR_TYPE_PROXIMITY:
+			return "prox";
+		case SENSOR_TYPE_GRAVITY:
+			return "gravity";
+		case SENSOR_TYPE_LINEAR_ACCELERATION:
+			return "linear_accel";
+		case SENSOR_TYPE_ROTATION_VECTOR:
+			return "rot_vec";
+		case SENSOR_TYPE_RELATIVE_HUMIDITY:
+			return "humidity";
+		case SENSOR_TYPE_AMBIENT_TEMPERATURE:
+			return "ambient_temp";
+		case SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED:
+			return "mag_uncal";
+		case SENSOR_TYPE_GAME_ROTATION_VECTOR:
+			return "game_rot_vec";
+		case SENSOR_TYPE_GYROSCOPE_UNCALIBRATED:
+			return "gyro_uncal";
+		case SENSOR_TYPE_SIGNIFICANT_MOTION:
+			return "sig_motion";
+		case SENSOR_TYPE_STEP_COUNTER:
+			return "step_counter";
+		case SENSOR_TYPE_STEP_DETECTOR:
+			return "step_detect";
+		case SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR:
+			return "geomag_rot_vec";
+		default:
+			return "";
+	}
+}
+
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+/* Helper function to convert sensor type to its string type of sensor_t */
+static inline const char* type_to_string(int type)
+{
+	switch (type) {
+		case SENSOR_TYPE_ACCELEROMETER:
+			return SENSOR_STRING_TYPE_ACCELEROMETER;
+		case SENSOR_TYPE_MAGNETIC_FIELD:
+			return SENSOR_STRING_TYPE_MAGNETIC_FIELD;
+		case SENSOR_TYPE_ORIENTATION:
+			return SENSOR_STRING_TYPE_ORIENTATION;
+		case SENSOR_TYPE_GYROSCOPE:
+			return SENSOR_STRING_TYPE_GYROSCOPE;
+		case SENSOR_TYPE_LIGHT:
+			return SENSOR_STRING_TYPE_LIGHT;
+		case SENSOR_TYPE_PRESSURE:
+			return SENSOR_STRING_TYPE_PRESSURE;
+		case SENSOR_TYPE_TEMPERATURE:
+			return SENSOR_STRING_TYPE_TEMPERATURE;
+		case SENSOR_TYPE_PROXIMITY:
+			return SENSOR_STRING_TYPE_PROXIMITY;
+		case SENSOR_TYPE_GRAVITY:
+			return SENSOR_STRING_TYPE_GRAVITY;
+		case SENSOR_TYPE_LINEAR_ACCELERATION:
+			return SENSOR_STRING_TYPE_LINEAR_ACCELERATION;
+		case SENSOR_TYPE_ROTATION_VECTOR:
+			return SENSOR_STRING_TYPE_ROTATION_VECTOR;
+		case SENSOR_TYPE_RELATIVE_HUMIDITY:
+			return SENSOR_STRING_TYPE_RELATIVE_HUMIDITY;
+		case SENSOR_TYPE_AMBIENT_TEMPERATURE:
+			return SENSOR_STRING_TYPE_AMBIENT_TEMPERATURE;
+		case SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED:
+			return SENSOR_STRING_TYPE_MAGNETIC_FIELD_UNCALIBRATED;
+		case SENSOR_TYPE_GAME_ROTATION_VECTOR:
+			return SENSOR_STRING_TYPE_GAME_ROTATION_VECTOR;
+		case SENSOR_TYPE_GYROSCOPE_UNCALIBRATED:
+			return SENSOR_STRING_TYPE_GYROSCOPE_UNCALIBRATED;
+		case SENSOR_TYPE_SIGNIFICANT_MOTION:
+			return SENSOR_STRING_TYPE_SIGNIFICANT_MOTION;
+		case SENSOR_TYPE_STEP_DETECTOR:
+			return SENSOR_STRING_TYPE_STEP_DETECTOR;
+		case SENSOR_TYPE_STEP_COUNTER:
+			return SENSOR_STRING_TYPE_STEP_COUNTER;
+		case SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR:
+			return SENSOR_STRING_TYPE_GEOMAGNETIC_ROTATION_VECTOR;
+		default:
+			return "";
+	}
+}
+#endif
+
 __END_DECLS
 
 #endif  // ANDROID_SENSORS_H
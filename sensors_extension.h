@@ -111,6 +111,52 @@ struct cal_cmd_t{
     bool apply_now; /* Whether to apply the calibration parameters now */
 };
 
+#define SENSORS_DIRECT_CHANNEL_VERSION 1
+
+#define SENSORS_DIRECT_FORMAT_EVENT 0 /* the ring holds sensors_event_t */
+#define SENSORS_DIRECT_FORMAT_RAW   1 /* the ring holds sensors_raw_frame_t */
+
+/*
+ *The memory of a direct channel starts with this header, followed by a ring
+ *of capacity events at event_offset, in the format given by format. write_count
+ *is the number of events written since the channel was registered, and event
+ *n is stored at index n % capacity once write_count is greater than n. The
+ *writer never waits for the reader: the copy of event n is only valid if
+ *write_count, loaded again after the copy and an acquire fence, is less than
+ *n + capacity.
+ */
+struct sensors_direct_header_t {
+    uint32_t version;
+    uint32_t capacity; /* number of events in the ring, a power of two */
+    uint32_t event_offset; /* offset of the ring from the start of the memory */
+    uint32_t format; /* SENSORS_DIRECT_FORMAT_*, 0 before raw frames existed */
+    uint64_t write_count; /* atomic, updated with release semantics */
+};
+
+/*
+ *An event of a raw channel: the counts of the driver before scaling and
+ *calibration. value[i] * scale[i] of the sensors_raw_scale_t of the sensor is
+ *the uncalibrated reading: data[i] of the sensors_event_t for the
+ *accelerometer and the pressure sensor, data[4 + i] for the magnetometer and
+ *the gyroscope, whose data[0..2] are calibrated.
+ */
+struct sensors_raw_frame_t {
+    int64_t timestamp;
+    int32_t sensor; /* handle of the sensor */
+    int32_t value[3];
+};
+
+struct sensors_raw_scale_t {
+    float scale[3];
+};
+
+/*
+ *Callback receiving a batch of count events in data, which is only valid
+ *during the call.
+ */
+typedef void (*sensors_event_callback_t)(void *cookie,
+        const sensors_event_t *data, int count);
+
 struct sensors_poll_device_1_ext_t {
     union {
 
@@ -133,6 +179,47 @@ struct sensors_poll_device_1_ext_t {
     /* return -1 on error. Otherwise return the calibration result */
     int (*calibrate)(struct sensors_poll_device_1_ext_t *dev,
             int handle, struct cal_cmd_t *para);
+
+    /*
+     *Create the direct channel of this device with room for count events.
+     *Return the fd of the shared memory to map, which stays owned by the
+     *device, or a negative errno.
+     */
+    int (*register_direct_channel)(struct sensors_poll_device_1_ext_t *dev,
+            int count);
+
+    /*
+     *Write the events of handle to the direct channel instead of poll() at
+     *period_ns, or stop them if period_ns is 0.
+     */
+    int (*config_direct_channel)(struct sensors_poll_device_1_ext_t *dev,
+            int handle, int64_t period_ns);
+
+    /*
+     *Deliver the events configured with config_direct_channel to callback
+     *instead of the direct channel memory, or to the memory again if callback
+     *is NULL. callback runs on the thread reading the sensor, its reader
+     *thread if it has one, so it must return quickly and must not call back
+     *into the device. Return -EBUSY if some sensors are configured already.
+     */
+    int (*register_event_callback)(struct sensors_poll_device_1_ext_t *dev,
+            sensors_event_callback_t callback, void *cookie);
+
+    /*
+     *Same as register_direct_channel, but the channel holds raw frames of the
+     *sensors configured with config_direct_channel. Only the sensors for which
+     *get_raw_scale succeeds are written to it.
+     */
+    int (*register_raw_channel)(struct sensors_poll_device_1_ext_t *dev,
+            int count);
+
+    /*
+     *Fill scale with the factors turning the raw counts of handle into its
+     *uncalibrated readings, see sensors_raw_frame_t. Return -EINVAL if the
+     *sensor has no raw frames.
+     */
+    int (*get_raw_scale)(struct sensors_poll_device_1_ext_t *dev,
+            int handle, struct sensors_raw_scale_t *scale);
 };
 
 struct cal_result_t {
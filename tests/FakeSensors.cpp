@@ -0,0 +1,228 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/stat.h>
+
+#include "FakeSensors.h"
+
+/*****************************************************************************/
+
+extern struct sensors_module_t HAL_MODULE_INFO_SYM;
+
+static int fake_count;
+
+static int remove_node(const char *path, const struct stat *, int, struct FTW *)
+{
+	return remove(path);
+}
+
+static int write_node(const char *dir, const char *node, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static int write_node(const char *dir, const char *node, const char *fmt, ...)
+{
+	char path[PATH_MAX];
+	va_list ap;
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, node);
+	file = fopen(path, "w");
+	if (file == NULL)
+		return -errno;
+
+	va_start(ap, fmt);
+	vfprintf(file, fmt, ap);
+	va_end(ap);
+	fclose(file);
+
+	return 0;
+}
+
+static int make_dir(const char *fmt, const char *arg, char *path)
+{
+	snprintf(path, PATH_MAX, fmt, TEST_ROOT, arg);
+	if (mkdir(path, 0755) && (errno != EEXIST))
+		return -errno;
+	return 0;
+}
+
+int fake_sensors_reset()
+{
+	char path[PATH_MAX];
+
+	fake_count = 0;
+	if ((nftw(TEST_ROOT, remove_node, 16, FTW_DEPTH | FTW_PHYS) < 0) && (errno != ENOENT))
+		return -errno;
+
+	if (make_dir("%s%s", "", path) || make_dir("%s%s", "/class", path) ||
+			make_dir("%s%s", "/class/sensors", path) ||
+			make_dir("%s%s", "/class/input", path) ||
+			make_dir("%s%s", "/dev", path) ||
+			make_dir("%s%s", "/dev/input", path))
+		return -errno;
+
+	return 0;
+}
+
+int fake_sensors_add(const char *name, int type, int min_delay)
+{
+	char class_dev[PATH_MAX];
+	char input_dev[PATH_MAX];
+	char path[PATH_MAX];
+	char node[32];
+	int n = fake_count++;
+	int fd;
+
+	/* The input device and its event node */
+	snprintf(node, sizeof(node), "input%d", n);
+	if (make_dir("%s/class/input/%s", node, input_dev))
+		return -errno;
+	write_node(input_dev, "name", "%s\n", name);
+
+	snprintf(node, sizeof(node), "input%d/event%d", n, n);
+	if (make_dir("%s/class/input/%s", node, path))
+		return -errno;
+
+	snprintf(node, sizeof(node), "event%d", n);
+	if (make_dir("%s/class/input/%s", node, path))
+		return -errno;
+	snprintf(path, sizeof(path), "%s/class/input/event%d/device", TEST_ROOT, n);
+	if (symlink(input_dev, path))
+		return -errno;
+
+	snprintf(path, sizeof(path), "%s/dev/input/event%d", TEST_ROOT, n);
+	if (mkfifo(path, 0644))
+		return -errno;
+
+	/* Open both ends, so the HAL never sees the FIFO hang up */
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	/* The sensors class device */
+	if (make_dir("%s/class/sensors/%s", name, class_dev)) {
+		close(fd);
+		return -errno;
+	}
+	write_node(class_dev, "name", "%s\n", name);
+	write_node(class_dev, "vendor", "test\n");
+	write_node(class_dev, "version", "1\n");
+	write_node(class_dev, "type", "%d\n", type);
+	write_node(class_dev, "max_range", "1000.0\n");
+	write_node(class_dev, "resolution", "0.01\n");
+	write_node(class_dev, "sensor_power", "0.1\n");
+	write_node(class_dev, "min_delay", "%d\n", min_delay);
+	write_node(class_dev, "enable", "0\n");
+	write_node(class_dev, "poll_delay", "200000000\n");
+
+	snprintf(path, sizeof(path), "%s/class/sensors/%s/device", TEST_ROOT, name);
+	if (symlink(input_dev, path)) {
+		close(fd);
+		return -errno;
+	}
+
+	return fd;
+}
+
+int fake_sensors_report(int fd, const int *values, int count, int64_t timestamp)
+{
+	struct input_event event[16];
+	int n = 0;
+	int i;
+
+	if (count > 3)
+		return -EINVAL;
+
+	memset(event, 0, sizeof(event));
+	for (i = 0; i < count; i++) {
+		event[n].type = EV_ABS;
+		event[n].code = ABS_X + i;
+		event[n++].value = values[i];
+	}
+
+	event[n].type = EV_SYN;
+	event[n].code = SYN_TIME_SEC;
+	event[n++].value = timestamp / 1000000000LL;
+	event[n].type = EV_SYN;
+	event[n].code = SYN_TIME_NSEC;
+	event[n++].value = timestamp % 1000000000LL;
+	event[n].type = EV_SYN;
+	event[n++].code = SYN_REPORT;
+
+	if (write(fd, event, n * sizeof(event[0])) != (ssize_t)(n * sizeof(event[0])))
+		return -errno;
+
+	return 0;
+}
+
+struct sensors_poll_device_1 *fake_sensors_open(const struct sensor_t **list, int *count)
+{
+	struct sensors_module_t *module = &HAL_MODULE_INFO_SYM;
+	struct hw_device_t *dev;
+
+	/* Keep the discovery cache in the fake tree, unless the test set it */
+	setenv("sensors.discovery.cache", TEST_ROOT "/discovery.cache", 0);
+
+	if (module->common.methods->open(&module->common, SENSORS_HARDWARE_POLL, &dev))
+		return NULL;
+
+	*count = module->get_sensors_list(module, list);
+
+	return (struct sensors_poll_device_1 *)dev;
+}
+
+int fake_sensors_find(const struct sensor_t *list, int count, int type)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (list[i].type == type)
+			return list[i].handle;
+	}
+
+	return -1;
+}
+
+int64_t fake_sensors_now()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
@@ -0,0 +1,66 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#ifndef ANDROID_FAKE_SENSORS_H
+#define ANDROID_FAKE_SENSORS_H
+
+#include <stdint.h>
+#include <hardware/sensors.h>
+
+/*****************************************************************************/
+
+/* A fake sensors class and input tree under TEST_ROOT, which the HAL of the
+ * host build is pointed at. Each sensor gets a class device linked to an input
+ * device, whose event node is a FIFO the test writes its input events to.
+ */
+
+/* Remove the tree of the last run and create an empty one. Return 0 or -errno. */
+int fake_sensors_reset();
+
+/* Add a class device named name of the given type. Return the fd the events
+ * of the sensor are written to, or -errno.
+ */
+int fake_sensors_add(const char *name, int type, int min_delay);
+
+/* Write an EV_ABS report of count axes followed by a SYN_TIME stamp of
+ * timestamp and a SYN_REPORT. Return 0 or -errno.
+ */
+int fake_sensors_report(int fd, const int *values, int count, int64_t timestamp);
+
+/* Open the HAL on the fake tree. Return NULL on failure. */
+struct sensors_poll_device_1 *fake_sensors_open(const struct sensor_t **list, int *count);
+
+/* Return the handle of the first sensor of type in list, or -1 */
+int fake_sensors_find(const struct sensor_t *list, int count, int type);
+
+/* Return CLOCK_MONOTONIC in ns, the clock of the HAL timestamps */
+int64_t fake_sensors_now();
+
+/*****************************************************************************/
+
+#endif  // ANDROID_FAKE_SENSORS_H
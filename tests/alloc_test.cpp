@@ -0,0 +1,244 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <execinfo.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FakeSensors.h"
+
+/* Checks that activate(), batch() and poll() do not allocate once the HAL is
+ * warmed up, on any of its threads.
+ */
+
+/*****************************************************************************/
+
+#define WARMUP_ROUNDS		3
+#define ROUNDS			50
+#define BACKTRACE_DEPTH		32
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+static volatile int armed;
+static volatile int allocations;
+static void *first_trace[BACKTRACE_DEPTH];
+static int first_depth;
+static __thread int in_hook;
+
+static void count_allocation()
+{
+	if (!armed || in_hook)
+		return;
+
+	in_hook = 1;
+	if (__sync_fetch_and_add(&allocations, 1) == 0)
+		first_depth = backtrace(first_trace, BACKTRACE_DEPTH);
+	in_hook = 0;
+}
+
+extern "C" void *malloc(size_t size)
+{
+	count_allocation();
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+	count_allocation();
+	return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	count_allocation();
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	count_allocation();
+	*ptr = __libc_memalign(alignment, size);
+	return (*ptr == NULL) ? ENOMEM : 0;
+}
+
+void *operator new(size_t size)
+{
+	void *ptr;
+
+	count_allocation();
+	ptr = __libc_malloc(size);
+	if (ptr == NULL)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+/*****************************************************************************/
+
+/* Enable the sensor, batch it at period_ns, read back one report and disable it */
+static int run_round(struct sensors_poll_device_1 *dev, int handle, int fd,
+		int64_t period_ns, int64_t timeout)
+{
+	static const int values[3] = { 1, 2, 3 };
+	sensors_event_t data[16];
+	int got = 0;
+	int err;
+	int n;
+	int i;
+
+	err = dev->batch(dev, handle, 0, period_ns, timeout);
+	if (err)
+		return err;
+
+	err = dev->activate(&dev->v0, handle, 1);
+	if (err)
+		return err;
+
+	/* The first events after an enable are dropped */
+	usleep(20000);
+
+	err = fake_sensors_report(fd, values, 3, fake_sensors_now());
+	if (err)
+		return err;
+
+	if (timeout)
+		dev->flush(dev, handle);
+
+	while (!got) {
+		n = dev->poll(&dev->v0, data, 16);
+		if (n < 0)
+			return n;
+		for (i = 0; i < n; i++) {
+			if ((data[i].type == SENSOR_TYPE_ACCELEROMETER) && (data[i].sensor == handle))
+				got = 1;
+		}
+	}
+
+	return dev->activate(&dev->v0, handle, 0);
+}
+
+int main()
+{
+	struct sensors_poll_device_1 *dev;
+	const struct sensor_t *list;
+	int count;
+	int handle;
+	int fd;
+	int err;
+	int i;
+
+	setenv("sensors.wakelock", "local", 1);
+	/* Never wait forever for an event */
+	alarm(30);
+
+	err = fake_sensors_reset();
+	if (err) {
+		fprintf(stderr, "alloc_test: cannot create %s: %s\n", TEST_ROOT, strerror(-err));
+		return 1;
+	}
+
+	fd = fake_sensors_add("accelerometer", SENSOR_TYPE_ACCELEROMETER, 10000);
+	if (fd < 0) {
+		fprintf(stderr, "alloc_test: cannot add the sensor: %s\n", strerror(-fd));
+		return 1;
+	}
+
+	dev = fake_sensors_open(&list, &count);
+	handle = fake_sensors_find(list, count, SENSOR_TYPE_ACCELEROMETER);
+	if ((dev == NULL) || (handle < 0)) {
+		fprintf(stderr, "alloc_test: no accelerometer\n");
+		return 1;
+	}
+
+	/* Warm up both the streaming and the batching path, backtrace() included */
+	first_depth = backtrace(first_trace, BACKTRACE_DEPTH);
+	for (i = 0; i < WARMUP_ROUNDS; i++) {
+		if (run_round(dev, handle, fd, 20000000, 0) ||
+				run_round(dev, handle, fd, 20000000, 100000000)) {
+			fprintf(stderr, "alloc_test: warm-up round %d failed\n", i);
+			return 1;
+		}
+	}
+
+	armed = 1;
+	for (i = 0; i < ROUNDS; i++) {
+		err = run_round(dev, handle, fd, (i & 1) ? 20000000 : 10000000,
+				(i & 2) ? 100000000 : 0);
+		if (err)
+			break;
+	}
+	armed = 0;
+
+	if (err) {
+		fprintf(stderr, "alloc_test: round %d failed: %s\n", i, strerror(-err));
+		return 1;
+	}
+
+	if (allocations) {
+		fprintf(stderr, "alloc_test: FAIL: %d allocations after warm-up, first one from:\n",
+				allocations);
+		backtrace_symbols_fd(first_trace, first_depth, STDERR_FILENO);
+		return 1;
+	}
+
+	printf("alloc_test: PASS: %d rounds without allocations\n", ROUNDS);
+	dev->common.close(&dev->common);
+
+	return 0;
+}
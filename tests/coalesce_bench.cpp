@@ -0,0 +1,207 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FakeSensors.h"
+
+/* Runs an accelerometer at 200 Hz and a gyroscope at 250 Hz, streaming and
+ * batched with a max report latency of 100 ms. A thread plays the hardware
+ * and reports each sensor at its own period. The poll() returns per second
+ * stand for the wakeups of the framework thread.
+ */
+
+/*****************************************************************************/
+
+#define DURATION_NS	2000000000LL
+
+struct Fake {
+	const char *name;
+	int type;
+	int64_t period_ns;
+	int fd;
+	int handle;
+	int delivered;
+};
+
+static struct Fake fakes[] = {
+	{ "accelerometer", SENSOR_TYPE_ACCELEROMETER, 5000000, -1, -1, 0 },
+	{ "gyroscope", SENSOR_TYPE_GYROSCOPE, 4000000, -1, -1, 0 },
+};
+
+#define FAKES	(int)(sizeof(fakes) / sizeof(fakes[0]))
+
+struct BenchMode {
+	const char *name;
+	int64_t latency_ns;
+};
+
+static const struct BenchMode modes[] = {
+	{ "streaming", 0 },
+	{ "batched", 100000000 },
+};
+
+static volatile bool done;
+
+static void *hardware_thread(void *)
+{
+	static const int values[3] = { 1, 2, 3 };
+	int64_t next[FAKES];
+	int64_t start, now, first;
+	struct timespec ts;
+	int i;
+
+	start = fake_sensors_now();
+	for (i = 0; i < FAKES; i++)
+		next[i] = start + fakes[i].period_ns;
+
+	for (;;) {
+		first = next[0];
+		for (i = 1; i < FAKES; i++) {
+			if (next[i] < first)
+				first = next[i];
+		}
+		if (first - start > DURATION_NS)
+			break;
+
+		ts.tv_sec = first / 1000000000LL;
+		ts.tv_nsec = first % 1000000000LL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		now = fake_sensors_now();
+		for (i = 0; i < FAKES; i++) {
+			if (next[i] != first)
+				continue;
+			fake_sensors_report(fakes[i].fd, values, 3, now);
+			next[i] += fakes[i].period_ns;
+		}
+	}
+
+	done = true;
+
+	return NULL;
+}
+
+static int run(const struct BenchMode *mode)
+{
+	struct sensors_poll_device_1 *dev;
+	const struct sensor_t *list;
+	sensors_event_t data[256];
+	pthread_t hardware;
+	int wakeups = 0;
+	int count;
+	int n, i, j;
+
+	dev = fake_sensors_open(&list, &count);
+	if (dev == NULL)
+		return 1;
+
+	for (i = 0; i < FAKES; i++) {
+		fakes[i].handle = fake_sensors_find(list, count, fakes[i].type);
+		if (fakes[i].handle < 0)
+			return 1;
+		dev->batch(dev, fakes[i].handle, 0, fakes[i].period_ns, mode->latency_ns);
+		dev->activate(&dev->v0, fakes[i].handle, 1);
+	}
+
+	if (pthread_create(&hardware, NULL, hardware_thread, NULL))
+		return 1;
+
+	while (!done) {
+		n = dev->poll(&dev->v0, data, 256);
+		if (n < 0)
+			break;
+		if (n > 0)
+			wakeups++;
+		for (i = 0; i < n; i++) {
+			for (j = 0; j < FAKES; j++) {
+				if (data[i].sensor == fakes[j].handle)
+					fakes[j].delivered++;
+			}
+		}
+	}
+	pthread_join(hardware, NULL);
+
+	printf("coalesce_bench: %-9s", mode->name);
+	for (i = 0; i < FAKES; i++)
+		printf(" %s %.1f Hz,", fakes[i].name, fakes[i].delivered * 1e9 / DURATION_NS);
+	printf(" %.1f wakeups/s\n", wakeups * 1e9 / DURATION_NS);
+	fflush(stdout);
+
+	return 0;
+}
+
+int main()
+{
+	unsigned int i;
+	int status;
+	pid_t pid;
+	int j;
+
+	setenv("sensors.wakelock", "local", 1);
+	/* Never wait forever for an event */
+	alarm(60);
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		/* Every run is a fresh process and tree, as the HAL is a singleton */
+		if (fake_sensors_reset()) {
+			fprintf(stderr, "coalesce_bench: cannot create %s\n", TEST_ROOT);
+			return 1;
+		}
+		for (j = 0; j < FAKES; j++) {
+			fakes[j].fd = fake_sensors_add(fakes[j].name, fakes[j].type, 1000);
+			if (fakes[j].fd < 0) {
+				fprintf(stderr, "coalesce_bench: cannot add %s: %s\n",
+						fakes[j].name, strerror(-fakes[j].fd));
+				return 1;
+			}
+		}
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0)
+			_exit(run(&modes[i]));
+		if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) ||
+				WEXITSTATUS(status)) {
+			fprintf(stderr, "coalesce_bench: %s: run failed\n", modes[i].name);
+			return 1;
+		}
+
+		for (j = 0; j < FAKES; j++)
+			close(fakes[j].fd);
+	}
+
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FakeSensors.h"
+
+/* Measures the latency from an accelerometer report to its return from
+ * poll(), with the other sensors idle and while a second thread toggles
+ * them and changes their rate as fast as it can. The poll path reads the
+ * sensor state from snapshots, so it should not wait behind the control path.
+ * On a single CPU the toggling thread also takes the CPU from the poll thread,
+ * so it runs once more at the lowest priority to tell the two apart.
+ */
+
+/*****************************************************************************/
+
+#define EVENTS		2000
+#define PERIOD_NS	1000000LL
+
+struct Bench {
+	struct sensors_poll_device_1 *dev;
+	int accel;
+	int accel_fd;
+	int other[2];
+	volatile bool stop;
+	uint64_t toggles;
+	int nice;
+};
+
+struct BenchMode {
+	const char *name;
+	bool toggle;
+	int nice;
+};
+
+static const struct BenchMode modes[] = {
+	{ "idle", false, 0 },
+	{ "contended", true, 0 },
+	{ "contended, nice 19", true, 19 },
+};
+
+static int compare(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Report the accelerometer every PERIOD_NS, stamped with the time of writing */
+static void *report_thread(void *arg)
+{
+	struct Bench *b = (struct Bench *)arg;
+	static const int values[3] = { 1, 2, 3 };
+	struct timespec next;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; (i < EVENTS) && !b->stop; i++) {
+		next.tv_nsec += PERIOD_NS;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		fake_sensors_report(b->accel_fd, values, 3, fake_sensors_now());
+	}
+
+	return NULL;
+}
+
+/* The control path of another client of the HAL, at full speed */
+static void *toggle_thread(void *arg)
+{
+	struct Bench *b = (struct Bench *)arg;
+	int i = 0;
+
+	setpriority(PRIO_PROCESS, syscall(__NR_gettid), b->nice);
+	while (!b->stop) {
+		b->dev->batch(b->dev, b->other[i & 1], 0, (i & 2) ? 20000000 : 5000000, 0);
+		b->dev->activate(&b->dev->v0, b->other[i & 1], !(i & 4));
+		b->toggles++;
+		i++;
+	}
+
+	return NULL;
+}
+
+static int run(struct Bench *b, const struct BenchMode *mode, int64_t *latency)
+{
+	bool contended = mode->toggle;
+	pthread_t reporter, toggler;
+	sensors_event_t data[16];
+	int got = 0;
+	int n, i;
+
+	b->stop = false;
+	b->toggles = 0;
+	b->nice = mode->nice;
+
+	b->dev->batch(b->dev, b->accel, 0, PERIOD_NS, 0);
+	b->dev->activate(&b->dev->v0, b->accel, 1);
+	/* The first events after an enable are dropped */
+	usleep(20000);
+
+	if (contended && pthread_create(&toggler, NULL, toggle_thread, b))
+		return -1;
+	if (pthread_create(&reporter, NULL, report_thread, b))
+		return -1;
+
+	while (got < EVENTS) {
+		n = b->dev->poll(&b->dev->v0, data, 16);
+		if (n < 0)
+			break;
+		for (i = 0; (i < n) && (got < EVENTS); i++) {
+			if (data[i].sensor == b->accel)
+				latency[got++] = fake_sensors_now() - data[i].timestamp;
+		}
+	}
+
+	b->stop = true;
+	pthread_join(reporter, NULL);
+	if (contended)
+		pthread_join(toggler, NULL);
+	b->dev->activate(&b->dev->v0, b->other[0], 0);
+	b->dev->activate(&b->dev->v0, b->other[1], 0);
+	b->dev->activate(&b->dev->v0, b->accel, 0);
+
+	return (got == EVENTS) ? 0 : -1;
+}
+
+int main()
+{
+	static int64_t latency[EVENTS];
+	const struct sensor_t *list;
+	struct Bench b;
+	unsigned int i;
+	int count;
+	int fd;
+
+	setenv("sensors.wakelock", "local", 1);
+	/* Never wait forever for an event */
+	alarm(60);
+
+	memset(&b, 0, sizeof(b));
+	if (fake_sensors_reset()) {
+		fprintf(stderr, "contention_bench: cannot create %s\n", TEST_ROOT);
+		return 1;
+	}
+
+	b.accel_fd = fake_sensors_add("accelerometer", SENSOR_TYPE_ACCELEROMETER, 1000);
+	fd = fake_sensors_add("gyroscope", SENSOR_TYPE_GYROSCOPE, 1000);
+	if ((b.accel_fd < 0) || (fd < 0) ||
+			(fake_sensors_add("light", SENSOR_TYPE_LIGHT, 0) < 0)) {
+		fprintf(stderr, "contention_bench: cannot add the sensors\n");
+		return 1;
+	}
+
+	b.dev = fake_sensors_open(&list, &count);
+	if (b.dev == NULL)
+		return 1;
+	b.accel = fake_sensors_find(list, count, SENSOR_TYPE_ACCELEROMETER);
+	b.other[0] = fake_sensors_find(list, count, SENSOR_TYPE_GYROSCOPE);
+	b.other[1] = fake_sensors_find(list, count, SENSOR_TYPE_LIGHT);
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		if (run(&b, &modes[i], latency)) {
+			fprintf(stderr, "contention_bench: %s: run failed\n", modes[i].name);
+			return 1;
+		}
+		qsort(latency, EVENTS, sizeof(latency[0]), compare);
+		printf("contention_bench: %-18s report to poll() p50 %lld us, p99 %lld us, max %lld us"
+				" (%llu toggles)\n", modes[i].name,
+				(long long)latency[EVENTS / 2] / 1000,
+				(long long)latency[EVENTS * 99 / 100] / 1000,
+				(long long)latency[EVENTS - 1] / 1000,
+				(unsigned long long)b.toggles);
+	}
+
+	return 0;
+}
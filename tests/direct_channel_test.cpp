@@ -0,0 +1,245 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "SensorDirectChannel.h"
+
+/* Runs the consumer side of the direct channel protocol described in
+ * sensors_extension.h in a forked process, against the HAL writing the
+ * memfd. Every event written must be either read intact or counted as lost
+ * from write_count, in order. A writer paced by the reader measures the
+ * throughput of the channel without loss, a free running one against a slow
+ * reader the overrun path.
+ */
+
+/*****************************************************************************/
+
+#define CHANNEL_EVENTS		1024
+#define TOTAL_EVENTS		(4 * 1024 * 1024)
+#define MAX_BURST		16
+
+struct ReaderStats {
+	uint64_t next; // the next event the reader looks at, for a paced writer
+	uint64_t received;
+	uint64_t lost;
+	uint64_t discarded; // copies caught being overwritten by the re-check
+	uint64_t errors;
+};
+
+static int64_t now_ns()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+/* Event n carries n in all of its fields, so a torn copy shows */
+static void fill_event(sensors_event_t *event, uint64_t n)
+{
+	int i;
+
+	memset(event, 0, sizeof(*event));
+	event->version = sizeof(*event);
+	event->sensor = 1;
+	event->type = SENSOR_TYPE_ACCELEROMETER;
+	event->timestamp = n;
+	for (i = 0; i < 16; i++)
+		event->data[i] = (float)(n & 0xffff) + i;
+}
+
+static bool check_event(const sensors_event_t *event, uint64_t n)
+{
+	int i;
+
+	if ((event->timestamp != (int64_t)n) || (event->sensor != 1))
+		return false;
+	for (i = 0; i < 16; i++) {
+		if (event->data[i] != (float)(n & 0xffff) + i)
+			return false;
+	}
+
+	return true;
+}
+
+/* The consumer. It only gets the fd, like a client of the HAL would. */
+static void read_channel(int fd, bool slow, struct ReaderStats *stats)
+{
+	struct sensors_direct_header_t *header;
+	const sensors_event_t *ring;
+	sensors_event_t event;
+	uint64_t next = 0;
+	uint64_t w, v;
+	uint32_t cap;
+	size_t size;
+
+	header = (struct sensors_direct_header_t *)mmap(NULL, sizeof(*header),
+			PROT_READ, MAP_SHARED, fd, 0);
+	if (header == MAP_FAILED) {
+		stats->errors++;
+		return;
+	}
+	cap = header->capacity;
+	size = header->event_offset + cap * sizeof(sensors_event_t);
+	munmap(header, sizeof(*header));
+
+	header = (struct sensors_direct_header_t *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if ((header == MAP_FAILED) || (header->version != SENSORS_DIRECT_CHANNEL_VERSION) ||
+			(header->format != SENSORS_DIRECT_FORMAT_EVENT) || (cap & (cap - 1))) {
+		stats->errors++;
+		return;
+	}
+	ring = (const sensors_event_t *)((const char *)header + header->event_offset);
+
+	while (next < TOTAL_EVENTS) {
+		w = __atomic_load_n(&header->write_count, __ATOMIC_ACQUIRE);
+		if (w == next) {
+			sched_yield();
+			continue;
+		}
+
+		/* The writer lapped us */
+		if (w - next > cap) {
+			stats->lost += w - cap - next;
+			next = w - cap;
+		}
+
+		for (; next < w; next++) {
+			memcpy(&event, &ring[next & (cap - 1)], sizeof(event));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			v = __atomic_load_n(&header->write_count, __ATOMIC_RELAXED);
+			if (v >= next + cap) {
+				/* Overwritten while we copied it */
+				stats->discarded++;
+				stats->lost++;
+				continue;
+			}
+			if (!check_event(&event, next))
+				stats->errors++;
+			stats->received++;
+
+			if (slow && !(next & 0xfff))
+				usleep(100);
+		}
+		__atomic_store_n(&stats->next, next, __ATOMIC_RELEASE);
+	}
+
+	munmap(header, size);
+}
+
+static int run(bool paced)
+{
+	SensorDirectChannel channel(CHANNEL_EVENTS);
+	struct ReaderStats *stats;
+	sensors_event_t events[MAX_BURST];
+	uint64_t n = 0;
+	int64_t start, elapsed;
+	int status;
+	int burst = 1;
+	int i;
+	pid_t pid;
+
+	if (channel.initCheck()) {
+		fprintf(stderr, "direct_channel_test: no channel\n");
+		return 1;
+	}
+
+	stats = (struct ReaderStats *)mmap(NULL, sizeof(*stats), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED)
+		return 1;
+	memset(stats, 0, sizeof(*stats));
+
+	pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "direct_channel_test: fork failed: %s\n", strerror(errno));
+		return 1;
+	}
+	if (pid == 0) {
+		read_channel(channel.getFd(), !paced, stats);
+		_exit(0);
+	}
+
+	start = now_ns();
+	while (n < TOTAL_EVENTS) {
+		/* Never lap the reader */
+		while (paced && (n + burst - __atomic_load_n(&stats->next, __ATOMIC_ACQUIRE) >
+					CHANNEL_EVENTS))
+			sched_yield();
+		for (i = 0; (i < burst) && (n < TOTAL_EVENTS); i++)
+			fill_event(&events[i], n++);
+		channel.write(events, i);
+		burst = burst % MAX_BURST + 1;
+	}
+	elapsed = now_ns() - start;
+
+	if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "direct_channel_test: reader died\n");
+		return 1;
+	}
+
+	printf("direct_channel_test: %s writer: %.1f M events/s (%.0f MB/s), "
+			"read %llu, lost %llu (%llu caught overwritten)\n",
+			paced ? "paced" : "free running",
+			TOTAL_EVENTS * 1000.0 / elapsed,
+			TOTAL_EVENTS * sizeof(sensors_event_t) * 1000.0 / elapsed,
+			(unsigned long long)stats->received, (unsigned long long)stats->lost,
+			(unsigned long long)stats->discarded);
+
+	if (stats->errors || (stats->received + stats->lost != TOTAL_EVENTS) ||
+			(paced && stats->lost) || (!paced && !stats->lost)) {
+		fprintf(stderr, "direct_channel_test: FAIL: %llu bad events, %llu accounted for\n",
+				(unsigned long long)stats->errors,
+				(unsigned long long)(stats->received + stats->lost));
+		return 1;
+	}
+
+	munmap(stats, sizeof(*stats));
+	return 0;
+}
+
+int main()
+{
+	/* Never wait forever for the reader */
+	alarm(60);
+
+	if (run(true) || run(false))
+		return 1;
+
+	printf("direct_channel_test: PASS\n");
+	return 0;
+}
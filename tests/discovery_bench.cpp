@@ -0,0 +1,160 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "FakeSensors.h"
+
+/* Measures the time the HAL takes from open() to get_sensors_list() on the
+ * fake tree, probing serially and in parallel, and with the discovery cache
+ * warm. Every run is a fresh process, as the HAL is a singleton. The fake
+ * sysfs nodes are plain files, far faster than the attributes of real
+ * drivers, so only the difference between the modes means something; the
+ * parallel probe only pays off when the reads block in a driver.
+ */
+
+/*****************************************************************************/
+
+#define RUNS		25
+
+struct BenchMode {
+	const char *name;
+	const char *threads;
+	bool cached;
+};
+
+static const struct BenchMode modes[] = {
+	{ "serial probe", "1", false },
+	{ "probe", "4", false },
+	{ "warm cache", "4", true },
+};
+
+static const int types[] = {
+	SENSOR_TYPE_ACCELEROMETER,
+	SENSOR_TYPE_MAGNETIC_FIELD,
+	SENSOR_TYPE_GYROSCOPE,
+	SENSOR_TYPE_LIGHT,
+	SENSOR_TYPE_PROXIMITY,
+	SENSOR_TYPE_PRESSURE,
+};
+
+static int compare(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Open the HAL in a child process, return how long it took in ns or -1 */
+static int64_t open_once(const struct BenchMode *mode)
+{
+	const struct sensor_t *list;
+	int64_t elapsed = -1;
+	int fds[2];
+	int count;
+	int status;
+	pid_t pid;
+
+	if (pipe(fds))
+		return -1;
+
+	pid = fork();
+	if (pid == 0) {
+		setenv("sensors.discovery.threads", mode->threads, 1);
+		if (!mode->cached)
+			setenv("sensors.discovery.cache", "none", 1);
+		elapsed = fake_sensors_now();
+		if (fake_sensors_open(&list, &count) == NULL)
+			_exit(1);
+		elapsed = fake_sensors_now() - elapsed;
+		_exit(write(fds[1], &elapsed, sizeof(elapsed)) != sizeof(elapsed));
+	}
+
+	close(fds[1]);
+	if ((pid < 0) || (read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed)))
+		elapsed = -1;
+	close(fds[0]);
+	if ((pid > 0) && ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) ||
+				WEXITSTATUS(status)))
+		elapsed = -1;
+
+	return elapsed;
+}
+
+int main()
+{
+	int64_t runs[RUNS];
+	unsigned int i;
+	int fd;
+	int r;
+
+	setenv("sensors.wakelock", "local", 1);
+
+	if (fake_sensors_reset()) {
+		fprintf(stderr, "discovery_bench: cannot create %s\n", TEST_ROOT);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "sensor%u", i);
+		fd = fake_sensors_add(name, types[i], 10000);
+		if (fd < 0) {
+			fprintf(stderr, "discovery_bench: cannot add %s: %s\n", name, strerror(-fd));
+			return 1;
+		}
+	}
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		/* Write the cache before the warm runs */
+		if (modes[i].cached && (open_once(&modes[i]) < 0))
+			return 1;
+
+		for (r = 0; r < RUNS; r++) {
+			runs[r] = open_once(&modes[i]);
+			if (runs[r] < 0) {
+				fprintf(stderr, "discovery_bench: %s: open failed\n", modes[i].name);
+				return 1;
+			}
+		}
+
+		qsort(runs, RUNS, sizeof(runs[0]), compare);
+		printf("discovery_bench: %-12s %zu sensors: open to sensor list p50 %lld us, p90 %lld us\n",
+				modes[i].name, sizeof(types) / sizeof(types[0]),
+				(long long)runs[RUNS / 2] / 1000, (long long)runs[RUNS * 9 / 10] / 1000);
+	}
+
+	return 0;
+}
@@ -0,0 +1,233 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FakeSensors.h"
+
+/* Runs an accelerometer asked for 15 ms and a compass asked for 20 ms, with
+ * and without sensors.rate.harmonic. A thread plays the hardware: it reads
+ * back the poll delay the HAL wrote to each fake driver and reports each
+ * sensor at that period, both clocks starting together. The poll() returns
+ * per second stand for the CPU wakeups of the sensors service.
+ */
+
+/*****************************************************************************/
+
+#define DURATION_NS	2000000000LL
+
+struct Fake {
+	const char *name;
+	int type;
+	int64_t request_ns;
+	int fd;
+	int handle;
+	int64_t period_ns;
+	int delivered;
+};
+
+static struct Fake fakes[] = {
+	{ "accelerometer", SENSOR_TYPE_ACCELEROMETER, 15000000, -1, -1, 0, 0 },
+	{ "compass", SENSOR_TYPE_MAGNETIC_FIELD, 20000000, -1, -1, 0, 0 },
+};
+
+#define FAKES	(int)(sizeof(fakes) / sizeof(fakes[0]))
+
+static volatile bool done;
+
+/* The poll delay in ms the HAL last wrote to the class device of fake */
+static int64_t programmed_delay(const struct Fake *fake)
+{
+	char path[PATH_MAX];
+	char buf[32];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/class/sensors/%s/poll_delay", TEST_ROOT, fake->name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+
+	return strtoll(buf, NULL, 10) * 1000000LL;
+}
+
+static void *hardware_thread(void *)
+{
+	static const int values[3] = { 1, 2, 3 };
+	int64_t next[FAKES];
+	int64_t start, now, first;
+	struct timespec ts;
+	int i;
+
+	start = fake_sensors_now();
+	for (i = 0; i < FAKES; i++)
+		next[i] = start + fakes[i].period_ns;
+
+	for (;;) {
+		first = next[0];
+		for (i = 1; i < FAKES; i++) {
+			if (next[i] < first)
+				first = next[i];
+		}
+		if (first - start > DURATION_NS)
+			break;
+
+		ts.tv_sec = first / 1000000000LL;
+		ts.tv_nsec = first % 1000000000LL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		now = fake_sensors_now();
+		for (i = 0; i < FAKES; i++) {
+			if (next[i] != first)
+				continue;
+			fake_sensors_report(fakes[i].fd, values, 3, now);
+			next[i] += fakes[i].period_ns;
+		}
+	}
+
+	done = true;
+
+	return NULL;
+}
+
+static int run(const char *harmonic)
+{
+	struct sensors_poll_device_1 *dev;
+	const struct sensor_t *list;
+	sensors_event_t data[16];
+	pthread_t hardware;
+	int wakeups = 0;
+	int count;
+	int n, i, j;
+
+	setenv("sensors.rate.harmonic", harmonic, 1);
+	dev = fake_sensors_open(&list, &count);
+	if (dev == NULL)
+		return 1;
+
+	for (i = 0; i < FAKES; i++) {
+		fakes[i].handle = fake_sensors_find(list, count, fakes[i].type);
+		if (fakes[i].handle < 0)
+			return 1;
+		dev->batch(dev, fakes[i].handle, 0, fakes[i].request_ns, 0);
+		dev->activate(&dev->v0, fakes[i].handle, 1);
+	}
+
+	for (i = 0; i < FAKES; i++) {
+		fakes[i].period_ns = programmed_delay(&fakes[i]);
+		if (fakes[i].period_ns <= 0)
+			return 1;
+	}
+
+	if (pthread_create(&hardware, NULL, hardware_thread, NULL))
+		return 1;
+
+	while (!done) {
+		n = dev->poll(&dev->v0, data, 16);
+		if (n < 0)
+			break;
+		if (n > 0)
+			wakeups++;
+		for (i = 0; i < n; i++) {
+			for (j = 0; j < FAKES; j++) {
+				if (data[i].sensor == fakes[j].handle)
+					fakes[j].delivered++;
+			}
+		}
+	}
+	pthread_join(hardware, NULL);
+
+	printf("harmonic_bench: harmonic=%s:", harmonic);
+	for (i = 0; i < FAKES; i++)
+		printf(" %s %lld ms asked, %lld ms set, %.1f Hz delivered;", fakes[i].name,
+				(long long)fakes[i].request_ns / 1000000,
+				(long long)fakes[i].period_ns / 1000000,
+				fakes[i].delivered * 1e9 / DURATION_NS);
+	printf(" %.1f wakeups/s\n", wakeups * 1e9 / DURATION_NS);
+	fflush(stdout);
+
+	return 0;
+}
+
+int main()
+{
+	static const char *modes[] = { "0", "1" };
+	unsigned int i;
+	int status;
+	pid_t pid;
+	int j;
+
+	setenv("sensors.wakelock", "local", 1);
+	/* Never wait forever for an event */
+	alarm(60);
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		/* Every run is a fresh process and tree, as the HAL is a singleton */
+		if (fake_sensors_reset()) {
+			fprintf(stderr, "harmonic_bench: cannot create %s\n", TEST_ROOT);
+			return 1;
+		}
+		for (j = 0; j < FAKES; j++) {
+			fakes[j].fd = fake_sensors_add(fakes[j].name, fakes[j].type, 1000);
+			if (fakes[j].fd < 0) {
+				fprintf(stderr, "harmonic_bench: cannot add %s: %s\n",
+						fakes[j].name, strerror(-fakes[j].fd));
+				return 1;
+			}
+		}
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0)
+			_exit(run(modes[i]));
+		if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) ||
+				WEXITSTATUS(status)) {
+			fprintf(stderr, "harmonic_bench: harmonic=%s: run failed\n", modes[i]);
+			return 1;
+		}
+
+		for (j = 0; j < FAKES; j++)
+			close(fakes[j].fd);
+	}
+
+	return 0;
+}
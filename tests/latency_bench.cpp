@@ -0,0 +1,241 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FakeSensors.h"
+
+/* Measures the latency from an accelerometer report at 1 kHz to its return
+ * from poll(), for each mode of the poll thread, as a histogram. Every mode
+ * runs in a fresh process, as the HAL reads its properties at open. The
+ * stress modes keep busy processes on every CPU while the HAL runs.
+ */
+
+/*****************************************************************************/
+
+#define EVENTS		3000
+#define PERIOD_NS	1000000LL
+
+struct BenchMode {
+	const char *name;
+	const char *spin_us;
+	bool stress;
+	const char *fifo;
+};
+
+static const struct BenchMode modes[] = {
+	{ "blocking", "0", false, "0" },
+	{ "spin", "2000", false, "0" },
+	{ "stress", "0", true, "0" },
+	{ "stress, SCHED_FIFO", "0", true, "50" },
+};
+
+#define STRESS_PER_CPU	2
+
+/* Upper bounds of the histogram buckets in us, the last one is open */
+static const int buckets[] = { 10, 20, 50, 100, 200, 500, 1000 };
+
+#define BUCKETS		(int)(sizeof(buckets) / sizeof(buckets[0]))
+
+static int accel_fd;
+static volatile bool done;
+
+static int compare(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Report the accelerometer every PERIOD_NS, stamped with the time of writing */
+static void *report_thread(void *)
+{
+	static const int values[3] = { 1, 2, 3 };
+	struct timespec next;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!done) {
+		next.tv_nsec += PERIOD_NS;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		fake_sensors_report(accel_fd, values, 3, fake_sensors_now());
+	}
+
+	return NULL;
+}
+
+/* Start STRESS_PER_CPU busy processes per CPU, return how many or -1 */
+static int start_stress(pid_t *pids, int max)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int n;
+
+	for (n = 0; (n < cpus * STRESS_PER_CPU) && (n < max); n++) {
+		pids[n] = fork();
+		if (pids[n] < 0)
+			return -1;
+		if (pids[n] == 0) {
+			for (;;)
+				;
+		}
+	}
+
+	return n;
+}
+
+static void stop_stress(pid_t *pids, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+	}
+}
+
+static int run(const struct BenchMode *mode)
+{
+	pid_t stress[64];
+	int stressed = 0;
+	static int64_t latency[EVENTS];
+	struct sensors_poll_device_1 *dev;
+	const struct sensor_t *list;
+	sensors_event_t data[16];
+	int histogram[BUCKETS + 1];
+	pthread_t reporter;
+	int accel;
+	int got = 0;
+	int count;
+	int n, i, b;
+
+	setenv("sensors.poll.spin_us", mode->spin_us, 1);
+	setenv("sensors.sched.poll.fifo", mode->fifo, 1);
+	dev = fake_sensors_open(&list, &count);
+	if (dev == NULL)
+		return 1;
+
+	accel = fake_sensors_find(list, count, SENSOR_TYPE_ACCELEROMETER);
+	if (accel < 0)
+		return 1;
+	dev->batch(dev, accel, 0, PERIOD_NS, 0);
+	dev->activate(&dev->v0, accel, 1);
+	/* The first events after an enable are dropped */
+	usleep(20000);
+
+	if (mode->stress) {
+		stressed = start_stress(stress, sizeof(stress) / sizeof(stress[0]));
+		if (stressed < 0)
+			return 1;
+	}
+	if (pthread_create(&reporter, NULL, report_thread, NULL))
+		return 1;
+
+	while (got < EVENTS) {
+		n = dev->poll(&dev->v0, data, 16);
+		if (n < 0)
+			break;
+		for (i = 0; (i < n) && (got < EVENTS); i++) {
+			if (data[i].sensor == accel)
+				latency[got++] = fake_sensors_now() - data[i].timestamp;
+		}
+	}
+	done = true;
+	pthread_join(reporter, NULL);
+	stop_stress(stress, stressed);
+	if (got < EVENTS)
+		return 1;
+
+	memset(histogram, 0, sizeof(histogram));
+	for (i = 0; i < EVENTS; i++) {
+		for (b = 0; (b < BUCKETS) && (latency[i] >= buckets[b] * 1000LL); b++)
+			;
+		histogram[b]++;
+	}
+	qsort(latency, EVENTS, sizeof(latency[0]), compare);
+
+	printf("latency_bench: %-18s p50 %lld us, p99 %lld us, max %lld us\n", mode->name,
+			(long long)latency[EVENTS / 2] / 1000,
+			(long long)latency[EVENTS * 99 / 100] / 1000,
+			(long long)latency[EVENTS - 1] / 1000);
+	printf("latency_bench: %-18s", "");
+	for (b = 0; b < BUCKETS; b++)
+		printf(" <%dus %.1f%%", buckets[b], histogram[b] * 100.0 / EVENTS);
+	printf(" more %.1f%%\n", histogram[BUCKETS] * 100.0 / EVENTS);
+	fflush(stdout);
+
+	return 0;
+}
+
+int main()
+{
+	unsigned int i;
+	int status;
+	pid_t pid;
+
+	setenv("sensors.wakelock", "local", 1);
+	/* Never wait forever for an event */
+	alarm(60);
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		if (fake_sensors_reset()) {
+			fprintf(stderr, "latency_bench: cannot create %s\n", TEST_ROOT);
+			return 1;
+		}
+		accel_fd = fake_sensors_add("accelerometer", SENSOR_TYPE_ACCELEROMETER, 1000);
+		if (accel_fd < 0) {
+			fprintf(stderr, "latency_bench: cannot add the accelerometer: %s\n",
+					strerror(-accel_fd));
+			return 1;
+		}
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0)
+			_exit(run(&modes[i]));
+		if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) ||
+				WEXITSTATUS(status)) {
+			fprintf(stderr, "latency_bench: %s: run failed\n", modes[i].name);
+			return 1;
+		}
+		close(accel_fd);
+	}
+
+	return 0;
+}
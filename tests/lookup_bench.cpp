@@ -0,0 +1,184 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FakeSensors.h"
+#include "NativeSensorManager.h"
+
+/* Times the lookups of the poll path, getInfoByHandle, getInfoByType and
+ * getInfoByFd, against the binary search of a sorted vector they replaced,
+ * which is what DefaultKeyedVector::valueFor() does.
+ */
+
+/*****************************************************************************/
+
+#define KEYS		1024
+#define ROUNDS		20000
+
+/* The keys sorted, with their values at the same index, like KeyedVector */
+struct SortedTable {
+	int keys[64];
+	SensorContext *values[64];
+	int count;
+
+	void add(int key, SensorContext *value) {
+		int i;
+
+		for (i = count; (i > 0) && (keys[i - 1] > key); i--) {
+			keys[i] = keys[i - 1];
+			values[i] = values[i - 1];
+		}
+		keys[i] = key;
+		values[i] = value;
+		count++;
+	}
+
+	SensorContext *valueFor(int key) const {
+		int l = 0;
+		int h = count - 1;
+		int mid;
+
+		while (l <= h) {
+			mid = l + (h - l) / 2;
+			if (keys[mid] == key)
+				return values[mid];
+			if (keys[mid] < key)
+				l = mid + 1;
+			else
+				h = mid - 1;
+		}
+
+		return NULL;
+	}
+};
+
+static const int types[] = {
+	SENSOR_TYPE_ACCELEROMETER,
+	SENSOR_TYPE_MAGNETIC_FIELD,
+	SENSOR_TYPE_GYROSCOPE,
+	SENSOR_TYPE_LIGHT,
+	SENSOR_TYPE_PROXIMITY,
+	SENSOR_TYPE_PRESSURE,
+};
+
+static uintptr_t sink;
+
+/* ns per lookup of lookup(key) over keys */
+template <typename Lookup>
+static double time_lookups(const int *keys, Lookup lookup)
+{
+	uintptr_t acc = 0;
+	int64_t start;
+	int r, i;
+
+	start = fake_sensors_now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < KEYS; i++)
+			acc += (uintptr_t)lookup(keys[i]);
+	}
+	sink += acc;
+
+	return (double)(fake_sensors_now() - start) / ((double)ROUNDS * KEYS);
+}
+
+template <typename Lookup>
+static void report(const char *name, const int *keys, SortedTable *sorted, Lookup table)
+{
+	double flat = time_lookups(keys, table);
+	double search = time_lookups(keys, [sorted](int key) { return sorted->valueFor(key); });
+
+	printf("lookup_bench: %-15s %5.2f ns, sorted vector %5.2f ns\n", name, flat, search);
+}
+
+int main()
+{
+	SortedTable by_handle, by_type, by_fd;
+	const struct sensor_t *list;
+	int handles[KEYS], type_keys[KEYS], fds[KEYS];
+	SensorContext *ctx;
+	int count;
+	int fd;
+	int i, n;
+
+	setenv("sensors.wakelock", "local", 1);
+
+	if (fake_sensors_reset()) {
+		fprintf(stderr, "lookup_bench: cannot create %s\n", TEST_ROOT);
+		return 1;
+	}
+
+	for (i = 0; i < (int)(sizeof(types) / sizeof(types[0])); i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "sensor%d", i);
+		fd = fake_sensors_add(name, types[i], 10000);
+		if (fd < 0) {
+			fprintf(stderr, "lookup_bench: cannot add %s: %s\n", name, strerror(-fd));
+			return 1;
+		}
+	}
+
+	if (fake_sensors_open(&list, &count) == NULL)
+		return 1;
+
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	memset(&by_handle, 0, sizeof(by_handle));
+	memset(&by_type, 0, sizeof(by_type));
+	memset(&by_fd, 0, sizeof(by_fd));
+	n = sm.getSensorCount();
+	for (i = 0; i < n; i++) {
+		ctx = sm.getInfoByIndex(i);
+		by_handle.add(ctx->sensor->handle, ctx);
+		if (by_type.valueFor(ctx->sensor->type) == NULL)
+			by_type.add(ctx->sensor->type, ctx);
+		if (ctx->data_fd >= 0)
+			by_fd.add(ctx->data_fd, ctx);
+	}
+
+	/* The same pseudo-random sequence of sensors for all the lookups */
+	srand(1);
+	for (i = 0; i < KEYS; i++) {
+		ctx = sm.getInfoByIndex(rand() % n);
+		handles[i] = ctx->sensor->handle;
+		type_keys[i] = ctx->sensor->type;
+		fds[i] = by_fd.keys[rand() % by_fd.count];
+	}
+
+	printf("lookup_bench: %d sensors, %d fds\n", n, by_fd.count);
+	report("getInfoByHandle", handles, &by_handle,
+			[&sm](int key) { return sm.getInfoByHandle(key); });
+	report("getInfoByType", type_keys, &by_type,
+			[&sm](int key) { return sm.getInfoByType(key); });
+	report("getInfoByFd", fds, &by_fd,
+			[&sm](int key) { return sm.getInfoByFd(key); });
+
+	return sink == 0;
+}
@@ -0,0 +1,43 @@
+#ifndef TEST_CUTILS_LIST_H
+#define TEST_CUTILS_LIST_H
+
+#include <stddef.h>
+
+struct listnode {
+	struct listnode *next;
+	struct listnode *prev;
+};
+
+#define node_to_item(node, container, member) \
+	(container *) (((char*) (node)) - offsetof(container, member))
+
+#define list_for_each(node, list) \
+	for (node = (list)->next; node != (list); node = node->next)
+
+#define list_for_each_safe(node, n, list) \
+	for (node = (list)->next, n = node->next; node != (list); node = n, n = node->next)
+
+#define list_head(list) ((list)->next)
+#define list_empty(list) ((list) == (list)->next)
+
+static inline void list_init(struct listnode *node)
+{
+	node->next = node;
+	node->prev = node;
+}
+
+static inline void list_add_tail(struct listnode *head, struct listnode *item)
+{
+	item->next = head;
+	item->prev = head->prev;
+	head->prev->next = item;
+	head->prev = item;
+}
+
+static inline void list_remove(struct listnode *item)
+{
+	item->next->prev = item->prev;
+	item->prev->next = item->next;
+}
+
+#endif
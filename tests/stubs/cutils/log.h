@@ -0,0 +1,48 @@
+#ifndef TEST_CUTILS_LOG_H
+#define TEST_CUTILS_LOG_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+
+/* The HAL logs go to stderr, unless SENSORS_TEST_QUIET is set */
+extern int test_log_quiet;
+#define TEST_LOG(...) ((void)(test_log_quiet || fprintf(stderr, __VA_ARGS__)))
+
+#define ALOGE(...) TEST_LOG(__VA_ARGS__)
+#define ALOGW(...) TEST_LOG(__VA_ARGS__)
+#define ALOGI(...) TEST_LOG(__VA_ARGS__)
+#define ALOGD(...) TEST_LOG(__VA_ARGS__)
+#define ALOGV(...) ((void)0)
+#define ALOGE_IF(c, ...) ((c) ? ALOGE(__VA_ARGS__) : (void)0)
+#define ALOGW_IF(c, ...) ((c) ? ALOGW(__VA_ARGS__) : (void)0)
+#define ALOGI_IF(c, ...) ((c) ? ALOGI(__VA_ARGS__) : (void)0)
+#define ALOGD_IF(c, ...) ((c) ? ALOGD(__VA_ARGS__) : (void)0)
+
+/* bionic has them, glibc before 2.38 does not */
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+static inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size) {
+		size_t n = (len >= size) ? size - 1 : len;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+
+static inline size_t strlcat(char *dst, const char *src, size_t size)
+{
+	size_t len = strnlen(dst, size);
+
+	return len + strlcpy(dst + len, src, size - len);
+}
+#endif
+
+#endif
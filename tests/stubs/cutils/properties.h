@@ -0,0 +1,11 @@
+#ifndef TEST_CUTILS_PROPERTIES_H
+#define TEST_CUTILS_PROPERTIES_H
+
+#define PROPERTY_KEY_MAX	32
+#define PROPERTY_VALUE_MAX	92
+
+/* The properties are read from the environment variables of the same name */
+int property_get(const char *key, char *value, const char *default_value);
+int property_set(const char *key, const char *value);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef TEST_LINUX_INPUT_H
+#define TEST_LINUX_INPUT_H
+
+#include_next <linux/input.h>
+
+/* The absolute time stamps of the MSM kernels */
+#ifndef SYN_TIME_SEC
+#define SYN_TIME_SEC	6
+#define SYN_TIME_NSEC	7
+#endif
+
+#endif
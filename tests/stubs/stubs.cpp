@@ -0,0 +1,24 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+/* The properties of the host build are read from the environment */
+
+int test_log_quiet = getenv("SENSORS_TEST_QUIET") != NULL;
+
+int property_get(const char *key, char *value, const char *default_value)
+{
+	const char *env = getenv(key);
+
+	if (env == NULL)
+		env = default_value != NULL ? default_value : "";
+	strlcpy(value, env, PROPERTY_VALUE_MAX);
+
+	return strlen(value);
+}
+
+int property_set(const char *key, const char *value)
+{
+	return setenv(key, value, 1);
+}
@@ -0,0 +1 @@
+#include <utils/Mutex.h>
@@ -0,0 +1 @@
+#include <cutils/log.h>
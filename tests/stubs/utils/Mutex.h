@@ -0,0 +1,40 @@
+#ifndef TEST_UTILS_MUTEX_H
+#define TEST_UTILS_MUTEX_H
+
+#include <pthread.h>
+
+namespace android {
+
+class Mutex {
+	pthread_mutex_t mMutex;
+	friend class Condition;
+
+public:
+	Mutex() { pthread_mutex_init(&mMutex, NULL); }
+	~Mutex() { pthread_mutex_destroy(&mMutex); }
+	int lock() { return -pthread_mutex_lock(&mMutex); }
+	void unlock() { pthread_mutex_unlock(&mMutex); }
+	int tryLock() { return -pthread_mutex_trylock(&mMutex); }
+
+	class Autolock {
+		Mutex &mLock;
+	public:
+		Autolock(Mutex &mutex) : mLock(mutex) { mLock.lock(); }
+		~Autolock() { mLock.unlock(); }
+	};
+};
+
+class Condition {
+	pthread_cond_t mCond;
+
+public:
+	Condition() { pthread_cond_init(&mCond, NULL); }
+	~Condition() { pthread_cond_destroy(&mCond); }
+	int wait(Mutex &mutex) { return -pthread_cond_wait(&mCond, &mutex.mMutex); }
+	void signal() { pthread_cond_signal(&mCond); }
+	void broadcast() { pthread_cond_broadcast(&mCond); }
+};
+
+}
+
+#endif
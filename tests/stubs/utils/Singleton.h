@@ -0,0 +1,35 @@
+#ifndef TEST_UTILS_SINGLETON_H
+#define TEST_UTILS_SINGLETON_H
+
+#include <utils/Mutex.h>
+
+namespace android {
+
+template <typename TYPE>
+class Singleton {
+	static Mutex sLock;
+	static TYPE *sInstance;
+
+public:
+	static TYPE& getInstance() {
+		Mutex::Autolock _l(sLock);
+		if (sInstance == NULL)
+			sInstance = new TYPE();
+		return *sInstance;
+	}
+
+protected:
+	Singleton() {}
+	~Singleton() {}
+};
+
+}
+
+#define ANDROID_SINGLETON_STATIC_INSTANCE(TYPE) \
+	namespace android { \
+	template<> Mutex Singleton< TYPE >::sLock{}; \
+	template<> TYPE *Singleton< TYPE >::sInstance(NULL); \
+	template class Singleton< TYPE >; \
+	}
+
+#endif